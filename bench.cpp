@@ -1,6 +1,25 @@
 #include <benchmark/benchmark.h>
 
+#include <execution.h>
 #include <executors.h>
+#include <fiber_executor.h>
+#include <invoke_cache.h>
+#include <lock_free_stack.h>
+#include <parallel_scan.h>
+#include <parallel_sort.h>
+#include <sharded_executor.h>
+#include <single_flight.h>
+#include <static_graph.h>
+#include <worker_local.h>
+
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <random>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 class EmptyTask : public Task {
 public:
@@ -8,8 +27,13 @@ public:
     }
 };
 
+// The scheduling benchmarks are instantiated for every executor variant below.
+using CountingExecutor =
+    BasicExecutor<FifoQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy, CountingStatsPolicy>;
+
+template <class E>
 static void BenchmarkSimpleSubmit(benchmark::State& state) {
-    auto executor = MakeThreadPoolExecutor(state.range(0));
+    auto executor = MakeThreadPoolExecutor<E>(state.range(0));
     for (auto _ : state) {
         auto task = std::make_shared<EmptyTask>();
         executor->Submit(task);
@@ -17,10 +41,80 @@ static void BenchmarkSimpleSubmit(benchmark::State& state) {
     }
 }
 
-BENCHMARK(BenchmarkSimpleSubmit)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK_TEMPLATE(BenchmarkSimpleSubmit, Executor)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK_TEMPLATE(BenchmarkSimpleSubmit, LowLatencyExecutor)->Arg(1)->Arg(2);
+BENCHMARK_TEMPLATE(BenchmarkSimpleSubmit, CountingExecutor)->Arg(1)->Arg(2)->Arg(4);
+
+// Allocation and construction of a task without running it. range(0) selects a plain task or one
+// that also gets a dependency, which allocates the side record.
+static void BenchmarkTaskConstruction(benchmark::State& state) {
+    auto dependency = std::make_shared<EmptyTask>();
+    for (auto _ : state) {
+        auto task = std::make_shared<EmptyTask>();
+        if (state.range(0)) {
+            task->AddDependency(dependency);
+        }
+        benchmark::DoNotOptimize(task);
+    }
+    state.counters["task_bytes"] = sizeof(EmptyTask);
+}
+
+BENCHMARK(BenchmarkTaskConstruction)->Arg(0)->Arg(1);
+
+class CountdownTask : public Task {
+public:
+    explicit CountdownTask(std::atomic<int64_t>* remaining) : remaining_(remaining) {
+    }
+
+    void Run() override {
+        if (remaining_->fetch_sub(1) == 1) {
+            remaining_->notify_one();
+        }
+    }
+
+private:
+    std::atomic<int64_t>* remaining_;
+};
+
+// Spawns range(1) empty tasks from one thread in a loop, as ParallelFor does, and waits for all of
+// them. range(0) selects virtually dispatched tasks or FunctionTask with the same body.
+template <class E>
+static void BenchmarkEmptyTaskSpawn(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor<E>(2);
+    const int64_t num_tasks = state.range(1);
+    for (auto _ : state) {
+        std::atomic<int64_t> remaining{num_tasks};
+        for (int64_t i = 0; i < num_tasks; ++i) {
+            if (state.range(0)) {
+                executor->Submit(MakeFunctionTask([&remaining] {
+                    if (remaining.fetch_sub(1) == 1) {
+                        remaining.notify_one();
+                    }
+                }));
+            } else {
+                executor->Submit(std::make_shared<CountdownTask>(&remaining));
+            }
+        }
+        for (auto left = remaining.load(); left != 0; left = remaining.load()) {
+            remaining.wait(left);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * num_tasks);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkEmptyTaskSpawn, Executor)
+    ->Args({0, 1'000'000})
+    ->Args({1, 1'000'000})
+    ->Iterations(3)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkEmptyTaskSpawn, LowLatencyExecutor)
+    ->Args({1, 1'000'000})
+    ->Iterations(3)
+    ->Unit(benchmark::kMillisecond);
 
+template <class E>
 static void BenchmarkFanoutFanin(benchmark::State& state) {
-    auto executor = MakeThreadPoolExecutor(state.range(0));
+    auto executor = MakeThreadPoolExecutor<E>(state.range(0));
     for (auto _ : state) {
         auto first_task = std::make_shared<EmptyTask>();
         auto last_task = std::make_shared<EmptyTask>();
@@ -40,7 +134,7 @@ static void BenchmarkFanoutFanin(benchmark::State& state) {
     }
 }
 
-BENCHMARK(BenchmarkFanoutFanin)
+BENCHMARK_TEMPLATE(BenchmarkFanoutFanin, Executor)
     ->Args({1, 1})
     ->Args({1, 10})
     ->Args({1, 100})
@@ -50,6 +144,8 @@ BENCHMARK(BenchmarkFanoutFanin)
     ->Args({10, 1})
     ->Args({10, 10})
     ->Args({10, 100});
+BENCHMARK_TEMPLATE(BenchmarkFanoutFanin, LowLatencyExecutor)->Args({1, 100})->Args({2, 100});
+BENCHMARK_TEMPLATE(BenchmarkFanoutFanin, CountingExecutor)->Args({2, 100})->Args({10, 100});
 
 class Latch {
 public:
@@ -112,4 +208,1294 @@ BENCHMARK(BenchmarkScalableTimers)
     ->Args({5, 100000})
     ->Unit(benchmark::kMillisecond);
 
+struct SortRecord {
+    uint64_t key;
+    char payload[56];
+
+    bool operator<(const SortRecord& other) const {
+        return key < other.key;
+    }
+};
+
+template <class T>
+static std::vector<T> MakeSortInput(size_t n) {
+    std::mt19937_64 gen(n);
+    std::vector<T> data(n);
+    for (auto& x : data) {
+        if constexpr (std::is_same_v<T, SortRecord>) {
+            x.key = gen();
+        } else {
+            x = static_cast<T>(gen());
+        }
+    }
+    return data;
+}
+
+// range(0) is the number of workers, 0 stands for plain std::sort on the benchmark thread.
+template <class T>
+static void BenchmarkParallelSort(benchmark::State& state) {
+    const auto input = MakeSortInput<T>(state.range(1));
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    std::vector<T> data;
+    for (auto _ : state) {
+        state.PauseTiming();
+        data = input;
+        state.ResumeTiming();
+
+        if (state.range(0) == 0) {
+            std::sort(data.begin(), data.end());
+        } else {
+            ParallelSort(*executor, data.begin(), data.end());
+        }
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+static void ParallelSortArgs(benchmark::internal::Benchmark* bench) {
+    const int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int n : {10'000'000, 100'000'000}) {
+        bench->Args({0, n});
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            bench->Args({threads, n});
+        }
+    }
+}
+
+BENCHMARK_TEMPLATE(BenchmarkParallelSort, int)
+    ->Apply(ParallelSortArgs)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_TEMPLATE(BenchmarkParallelSort, SortRecord)
+    ->Apply(ParallelSortArgs)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Like BenchmarkParallelSort on ints, but with only 4 distinct keys.
+static void BenchmarkParallelSortFewKeys(benchmark::State& state) {
+    auto input = MakeSortInput<int>(state.range(1));
+    for (auto& x : input) {
+        x &= 3;
+    }
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    std::vector<int> data;
+    for (auto _ : state) {
+        state.PauseTiming();
+        data = input;
+        state.ResumeTiming();
+
+        if (state.range(0) == 0) {
+            std::sort(data.begin(), data.end());
+        } else {
+            ParallelSort(*executor, data.begin(), data.end());
+        }
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+BENCHMARK(BenchmarkParallelSortFewKeys)
+    ->Apply(ParallelSortArgs)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// range(0) is the number of workers, 0 stands for the serial std:: algorithm.
+static void ScanArgs(benchmark::internal::Benchmark* bench) {
+    const int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    bench->Args({0});
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        bench->Args({threads});
+    }
+}
+
+// 1GB of input, bytes_per_second counts the input once and the output once.
+static constexpr size_t kScanElements = (size_t{1} << 30) / sizeof(uint32_t);
+
+static void BenchmarkParallelInclusiveScan(benchmark::State& state) {
+    std::vector<uint32_t> input(kScanElements, 1);
+    std::vector<uint32_t> output(kScanElements);
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            std::inclusive_scan(input.begin(), input.end(), output.begin());
+        } else {
+            ParallelInclusiveScan(*executor, input.begin(), input.end(), output.begin());
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(state.iterations() * kScanElements * sizeof(uint32_t) * 2);
+}
+
+BENCHMARK(BenchmarkParallelInclusiveScan)
+    ->Apply(ScanArgs)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+static void BenchmarkParallelCopyIf(benchmark::State& state) {
+    std::vector<uint32_t> input(kScanElements);
+    std::iota(input.begin(), input.end(), 0);
+    std::vector<uint32_t> output(kScanElements);
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    auto pred = [](uint32_t x) { return (x * 2654435761u) >> 31; };
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            std::copy_if(input.begin(), input.end(), output.begin(), pred);
+        } else {
+            ParallelCopyIf(*executor, input.begin(), input.end(), output.begin(), pred);
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(state.iterations() * kScanElements * sizeof(uint32_t) * 3 / 2);
+}
+
+BENCHMARK(BenchmarkParallelCopyIf)
+    ->Apply(ScanArgs)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+static constexpr int kChainStages = 10;
+
+static void BenchmarkSenderChain(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    auto inc = [](int x) { return x + 1; };
+    for (auto _ : state) {
+        auto result = execution::SyncWait(
+            execution::Schedule(*executor) | execution::Then([] { return 0; }) |
+            execution::Then(inc) | execution::Then(inc) | execution::Then(inc) |
+            execution::Then(inc) | execution::Then(inc) | execution::Then(inc) |
+            execution::Then(inc) | execution::Then(inc) | execution::Then(inc));
+        benchmark::DoNotOptimize(result);
+    }
+}
+
+BENCHMARK(BenchmarkSenderChain)->Arg(1)->Arg(2)->Arg(4);
+
+static void BenchmarkNestedThenChain(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    for (auto _ : state) {
+        auto future = executor->Invoke<int>([] { return 0; });
+        for (int i = 1; i < kChainStages; ++i) {
+            future = executor->Then<int>(future, [future] { return future->Get() + 1; });
+        }
+        benchmark::DoNotOptimize(future->Get());
+    }
+}
+
+BENCHMARK(BenchmarkNestedThenChain)->Arg(1)->Arg(2)->Arg(4);
+
+// Shards finish after a log-normally distributed delay, simulated with time triggers so that no
+// worker is blocked while a shard is "in flight".
+static std::vector<FuturePtr<int>> SubmitSkewedShards(Executor& executor, size_t count,
+                                                      std::mt19937& gen) {
+    std::lognormal_distribution<double> latency_us(5.0, 1.0);
+    auto now = std::chrono::system_clock::now();
+    std::vector<FuturePtr<int>> shards;
+    shards.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto shard = std::make_shared<Future<int>>([i] { return static_cast<int>(i); });
+        shard->SetTimeTrigger(now + std::chrono::microseconds(static_cast<int>(latency_us(gen))));
+        executor.Submit(shard);
+        shards.push_back(shard);
+    }
+    return shards;
+}
+
+static void ReportFanoutLatency(benchmark::State& state, double first_us, double total_us) {
+    using benchmark::Counter;
+    state.counters["first_result_us"] = Counter(first_us, Counter::kAvgIterations);
+    state.counters["total_us"] = Counter(total_us, Counter::kAvgIterations);
+}
+
+static double MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+static void BenchmarkWhenEachFanout(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    std::mt19937 gen(42);
+    double first_us = 0, total_us = 0;
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        auto stream = executor->WhenEach(SubmitSkewedShards(*executor, state.range(1), gen));
+
+        int sum = 0;
+        bool first = true;
+        while (auto shard = stream->Take()) {
+            if (first) {
+                first_us += MicrosecondsSince(start);
+                first = false;
+            }
+            sum += shard->Get();
+        }
+        total_us += MicrosecondsSince(start);
+        benchmark::DoNotOptimize(sum);
+    }
+    ReportFanoutLatency(state, first_us, total_us);
+}
+
+BENCHMARK(BenchmarkWhenEachFanout)->Args({2, 1000})->Args({4, 1000})->Unit(benchmark::kMillisecond);
+
+static void BenchmarkWhenAllFanout(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    std::mt19937 gen(42);
+    double first_us = 0, total_us = 0;
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        auto results = executor->WhenAll(SubmitSkewedShards(*executor, state.range(1), gen))->Get();
+        // Nothing can be processed before the slowest shard is in.
+        first_us += MicrosecondsSince(start);
+
+        int sum = 0;
+        for (int x : results) {
+            sum += x;
+        }
+        total_us += MicrosecondsSince(start);
+        benchmark::DoNotOptimize(sum);
+    }
+    ReportFanoutLatency(state, first_us, total_us);
+}
+
+BENCHMARK(BenchmarkWhenAllFanout)->Args({2, 1000})->Args({4, 1000})->Unit(benchmark::kMillisecond);
+
+// range(0) replicas, range(1) successes required.
+static void BenchmarkWhenNQuorum(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(2);
+    std::mt19937 gen(42);
+    for (auto _ : state) {
+        auto replicas = SubmitSkewedShards(*executor, state.range(0), gen);
+        auto quorum = executor->WhenN(replicas, state.range(1), true)->Get();
+        benchmark::DoNotOptimize(quorum);
+    }
+}
+
+BENCHMARK(BenchmarkWhenNQuorum)->Args({5, 3})->Args({100, 10})->Unit(benchmark::kMicrosecond);
+
+// The pattern WhenN replaces: poll IsFinished until enough replicas have answered.
+static void BenchmarkPolledQuorum(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(2);
+    std::mt19937 gen(42);
+    for (auto _ : state) {
+        auto replicas = SubmitSkewedShards(*executor, state.range(0), gen);
+        std::vector<int> quorum;
+        while (quorum.size() < static_cast<size_t>(state.range(1))) {
+            quorum.clear();
+            for (auto& replica : replicas) {
+                if (quorum.size() < static_cast<size_t>(state.range(1)) &&
+                    replica->IsCompleted()) {
+                    quorum.push_back(replica->Get());
+                }
+            }
+        }
+        for (auto& replica : replicas) {
+            replica->Cancel();
+        }
+        benchmark::DoNotOptimize(quorum);
+    }
+}
+
+BENCHMARK(BenchmarkPolledQuorum)->Args({5, 3})->Args({100, 10})->Unit(benchmark::kMicrosecond);
+
+static void SpinFor(std::chrono::microseconds duration) {
+    auto until = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < until) {
+    }
+}
+
+// A doomed request: the first input fails right away, the others burn ~50us of CPU each.
+static void BenchmarkWhenAllDoomed(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(2);
+    const auto mode = static_cast<WhenAllMode>(state.range(0));
+    std::atomic<size_t> ran{0};
+    for (auto _ : state) {
+        std::vector<FuturePtr<int>> all;
+        all.push_back(executor->Invoke<int>([]() -> int { throw std::runtime_error("doomed"); }));
+        for (int i = 1; i < state.range(1); ++i) {
+            all.push_back(executor->Invoke<int>([&ran] {
+                SpinFor(std::chrono::microseconds(50));
+                ran++;
+                return 0;
+            }));
+        }
+        auto result = executor->WhenAll(all, mode);
+        result->Wait();
+        for (auto& input : all) {
+            input->Wait();
+        }
+    }
+    state.counters["inputs_run"] =
+        benchmark::Counter(ran.load(), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BenchmarkWhenAllDoomed)
+    ->Args({static_cast<int>(WhenAllMode::kWaitAll), 100})
+    ->Args({static_cast<int>(WhenAllMode::kFailFast), 100})
+    ->Unit(benchmark::kMicrosecond);
+
+struct BenchUser {
+    int id = 0;
+    std::string name;
+};
+
+struct BenchConfig {
+    std::vector<int> flags;
+};
+
+static void BenchmarkWhenAllTuple(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    for (auto _ : state) {
+        auto user = executor->Invoke<BenchUser>([] { return BenchUser{1, "user"}; });
+        auto config = executor->Invoke<BenchConfig>([] { return BenchConfig{{1, 2, 3}}; });
+        auto count = executor->Invoke<int>([] { return 3; });
+        auto all = executor->WhenAll(user, config, count)->Get();
+        benchmark::DoNotOptimize(all);
+    }
+}
+
+BENCHMARK(BenchmarkWhenAllTuple)->Arg(1)->Arg(2)->Arg(4);
+
+// The pattern the tuple overload replaces: one more task that blocks on every input.
+static void BenchmarkWhenAllTupleWrapper(benchmark::State& state) {
+    using Tuple = std::tuple<BenchUser, BenchConfig, int>;
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    for (auto _ : state) {
+        auto user = executor->Invoke<BenchUser>([] { return BenchUser{1, "user"}; });
+        auto config = executor->Invoke<BenchConfig>([] { return BenchConfig{{1, 2, 3}}; });
+        auto count = executor->Invoke<int>([] { return 3; });
+        auto all = executor->Invoke<Tuple>([user, config, count] {
+            return Tuple(user->Get(), config->Get(), count->Get());
+        })->Get();
+        benchmark::DoNotOptimize(all);
+    }
+}
+
+BENCHMARK(BenchmarkWhenAllTupleWrapper)->Arg(1)->Arg(2)->Arg(4);
+
+// range(0) requests over range(1) hot keys, issued in windows of 1000 outstanding requests.
+// range(2) selects SingleFlight (1) or plain Invoke (0).
+static void BenchmarkSingleFlight(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(4);
+    SingleFlight<int, int> flight(executor);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> key_dist(0, state.range(1) - 1);
+    std::atomic<size_t> computations{0};
+    const bool collapse = state.range(2);
+
+    for (auto _ : state) {
+        std::vector<FuturePtr<int>> window;
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            int key = key_dist(gen);
+            auto compute = [&computations, key] {
+                computations++;
+                SpinFor(std::chrono::microseconds(20));
+                return key;
+            };
+            window.push_back(collapse ? flight.Do(key, compute) : executor->Invoke<int>(compute));
+            if (window.size() == 1000) {
+                for (auto& request : window) {
+                    request->Get();
+                }
+                window.clear();
+            }
+        }
+        for (auto& request : window) {
+            request->Get();
+        }
+    }
+    state.counters["computations"] =
+        benchmark::Counter(computations.load(), benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BenchmarkSingleFlight)
+    ->Args({1'000'000, 1000, 1})
+    ->Args({1'000'000, 1000, 0})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Draws ranks in [0, n) with P(k) ~ 1 / (k + 1)^s.
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t n, double s) : cdf_(n) {
+        double sum = 0;
+        for (size_t k = 0; k < n; ++k) {
+            sum += 1.0 / std::pow(k + 1, s);
+            cdf_[k] = sum;
+        }
+        for (auto& x : cdf_) {
+            x /= sum;
+        }
+    }
+
+    template <class Gen>
+    size_t operator()(Gen& gen) {
+        double u = std::uniform_real_distribution<double>(0, 1)(gen);
+        return std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+// range(0) cache capacity over 100k Zipf(0.99) keys, 0 means no cache. Every miss costs 5us.
+static void BenchmarkInvokeCache(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(2);
+    InvokeCache<size_t, size_t> cache(executor, std::max<int64_t>(1, state.range(0)),
+                                      std::chrono::seconds(60));
+    ZipfDistribution zipf(100'000, 0.99);
+    std::mt19937 gen(42);
+    for (auto _ : state) {
+        size_t key = zipf(gen);
+        auto compute = [key] {
+            SpinFor(std::chrono::microseconds(5));
+            return key;
+        };
+        auto value =
+            state.range(0) ? cache.Invoke(key, compute) : executor->Invoke<size_t>(compute);
+        benchmark::DoNotOptimize(value->Get());
+    }
+    auto stats = cache.GetStats();
+    state.counters["hit_ratio"] =
+        stats.hits + stats.misses ? double(stats.hits) / (stats.hits + stats.misses) : 0;
+}
+
+BENCHMARK(BenchmarkInvokeCache)->Arg(0)->Arg(1000)->Arg(10'000)->Unit(benchmark::kMicrosecond);
+
+// Run times are 50us with a 2% tail of 5ms. range(0) is the number of copies, 1 means plain Invoke.
+// Reports latency percentiles and the CPU burnt by all copies relative to running without backups.
+static void BenchmarkHedge(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(4);
+    std::mt19937 gen(42);
+    std::atomic<int64_t> spun_us{0};
+    int64_t baseline_us = 0;
+    std::vector<double> latencies;
+
+    for (auto _ : state) {
+        std::bernoulli_distribution slow(0.02);
+        auto run_time = [&gen, &slow] {
+            return std::chrono::microseconds(slow(gen) ? 5000 : 50);
+        };
+        auto first_run = run_time();
+        auto backup_run = run_time();
+        baseline_us += first_run.count();
+
+        auto copy = std::make_shared<std::atomic<int>>(0);
+        auto body = [&spun_us, copy, first_run, backup_run](std::stop_token token) {
+            auto duration = (*copy)++ == 0 ? first_run : backup_run;
+            auto start = std::chrono::steady_clock::now();
+            while (std::chrono::steady_clock::now() - start < duration &&
+                   !token.stop_requested()) {
+            }
+            spun_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+            return 0;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        executor->Hedge<int>(body, std::chrono::microseconds(200), state.range(0))->Get();
+        latencies.push_back(MicrosecondsSince(start));
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    state.counters["p50_us"] = latencies[latencies.size() / 2];
+    state.counters["p99_us"] = latencies[latencies.size() * 99 / 100];
+    state.counters["cpu_overhead"] = double(spun_us.load()) / std::max<int64_t>(1, baseline_us);
+}
+
+BENCHMARK(BenchmarkHedge)->Arg(1)->Arg(2)->Arg(3)->Iterations(2000)->Unit(benchmark::kMicrosecond);
+
+// Resident set size of the process, in megabytes.
+static double ResidentMegabytes() {
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    std::ifstream("/proc/self/statm") >> total_pages >> resident_pages;
+    return double(resident_pages) * sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+// A Then chain of range(0) steps, every step carrying a 256 byte payload and capturing its
+// predecessor. The builder waits for the chain every 1000 steps, so at most that many steps are in
+// flight and anything beyond a constant growth is memory retained by finished steps.
+static void BenchmarkLongThenChain(benchmark::State& state) {
+    using Payload = std::vector<char>;
+    auto executor = MakeThreadPoolExecutor(2);
+    double peak_mb = 0;
+
+    for (auto _ : state) {
+        double baseline_mb = ResidentMegabytes();
+        auto future = executor->Invoke<Payload>([] { return Payload(256); });
+        for (int64_t i = 1; i < state.range(0); ++i) {
+            future = executor->Then<Payload>(future, [future] { return future->Get(); });
+            if (i % 1000 == 0) {
+                future->Wait();
+                peak_mb = std::max(peak_mb, ResidentMegabytes() - baseline_mb);
+            }
+        }
+        benchmark::DoNotOptimize(future->Get());
+    }
+    state.counters["peak_rss_growth_mb"] = peak_mb;
+}
+
+BENCHMARK(BenchmarkLongThenChain)->Arg(100'000)->Arg(1'000'000)->Iterations(1)->Unit(
+    benchmark::kMillisecond);
+
+// The same seven node graph, source -> three middle nodes -> two joins -> sink, declared statically
+// and built from futures with AddDependency on every run.
+template <int kId>
+struct GraphStep {
+    int operator()() const {
+        return kId;
+    }
+
+    int operator()(int x) const {
+        return x + kId;
+    }
+
+    int operator()(int x, int y) const {
+        return x + y + kId;
+    }
+};
+
+using StepA = GraphStep<0>;
+using StepB = GraphStep<1>;
+using StepC = GraphStep<2>;
+using StepD = GraphStep<3>;
+using StepE = GraphStep<4>;
+using StepF = GraphStep<5>;
+using StepG = GraphStep<6>;
+
+static void BenchmarkStaticGraph(benchmark::State& state) {
+    using static_graph::Deps;
+    using static_graph::Node;
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    static_graph::Graph<Node<StepA>, Node<StepB, Deps<StepA>>, Node<StepC, Deps<StepA>>,
+                        Node<StepD, Deps<StepA>>, Node<StepE, Deps<StepB, StepC>>,
+                        Node<StepF, Deps<StepC, StepD>>, Node<StepG, Deps<StepE, StepF>>>
+        graph;
+    for (auto _ : state) {
+        graph.Run(*executor);
+        benchmark::DoNotOptimize(graph.Get<StepG>());
+    }
+}
+
+BENCHMARK(BenchmarkStaticGraph)->Arg(1)->Arg(2)->Arg(4);
+
+static void BenchmarkDynamicGraph(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(state.range(0));
+    auto make = [](auto fn, std::vector<FuturePtr<int>> deps) {
+        auto future = std::make_shared<Future<int>>(fn);
+        for (auto& dep : deps) {
+            future->AddDependency(dep);
+        }
+        return future;
+    };
+    for (auto _ : state) {
+        auto a = make([] { return StepA{}(); }, {});
+        auto b = make([a] { return StepB{}(a->Get()); }, {a});
+        auto c = make([a] { return StepC{}(a->Get()); }, {a});
+        auto d = make([a] { return StepD{}(a->Get()); }, {a});
+        auto e = make([b, c] { return StepE{}(b->Get(), c->Get()); }, {b, c});
+        auto f = make([c, d] { return StepF{}(c->Get(), d->Get()); }, {c, d});
+        auto g = make([e, f] { return StepG{}(e->Get(), f->Get()); }, {e, f});
+        for (auto& task : {a, b, c, d, e, f, g}) {
+            executor->Submit(task);
+        }
+        benchmark::DoNotOptimize(g->Get());
+    }
+}
+
+BENCHMARK(BenchmarkDynamicGraph)->Arg(1)->Arg(2)->Arg(4);
+
+static constexpr size_t kScratchBytes = 64 << 10;
+
+// Every task writes a 64KB scratch buffer once per page and reads it back. range(0) selects where
+// the buffer comes from: 0 - a fresh allocation per task, 1 - WorkerLocal, 2 - ObjectPool.
+static void BenchmarkScratchBuffer(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(2);
+    WorkerLocal<std::vector<char>> local(*executor);
+    ObjectPool<std::vector<char>> pool(*executor);
+    std::atomic<int64_t> checksum{0};
+
+    auto body = [&checksum](char* buffer) {
+        for (size_t i = 0; i < kScratchBytes; i += 4096) {
+            buffer[i] = static_cast<char>(i >> 12);
+        }
+        int64_t sum = 0;
+        for (size_t i = 0; i < kScratchBytes; i += 4096) {
+            sum += buffer[i];
+        }
+        checksum.fetch_add(sum, std::memory_order_relaxed);
+    };
+
+    const int kTasks = 1000;
+    for (auto _ : state) {
+        std::vector<std::shared_ptr<Task>> tasks;
+        tasks.reserve(kTasks);
+        for (int i = 0; i < kTasks; ++i) {
+            std::shared_ptr<Task> task;
+            if (state.range(0) == 0) {
+                task = MakeFunctionTask([&] {
+                    std::unique_ptr<char[]> buffer(new char[kScratchBytes]);
+                    body(buffer.get());
+                });
+            } else if (state.range(0) == 1) {
+                task = MakeFunctionTask([&] {
+                    auto& buffer = local.Local();
+                    buffer.resize(kScratchBytes);
+                    body(buffer.data());
+                });
+            } else {
+                task = MakeFunctionTask([&] {
+                    auto buffer = pool.Acquire();
+                    buffer->resize(kScratchBytes);
+                    body(buffer->data());
+                });
+            }
+            executor->Submit(task);
+            tasks.push_back(std::move(task));
+        }
+        for (auto& task : tasks) {
+            task->Wait();
+        }
+    }
+    benchmark::DoNotOptimize(checksum.load());
+    state.SetItemsProcessed(state.iterations() * kTasks);
+}
+
+BENCHMARK(BenchmarkScratchBuffer)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond);
+
+// Treiber stacks for BenchmarkReclamation that never free popped nodes and that keep them in
+// shared_ptr, the two alternatives to an EpochDomain.
+class LeakingStack {
+public:
+    void Push(int value) {
+        auto* node = new Node{value, head_.load()};
+        while (!head_.compare_exchange_weak(node->next, node)) {
+        }
+    }
+
+    std::optional<int> Pop() {
+        Node* head = head_.load();
+        while (head && !head_.compare_exchange_weak(head, head->next)) {
+        }
+        return head ? std::optional(head->value) : std::nullopt;
+    }
+
+private:
+    struct Node {
+        int value;
+        Node* next;
+    };
+
+    std::atomic<Node*> head_ = nullptr;
+};
+
+class SharedPtrStack {
+public:
+    void Push(int value) {
+        auto node = std::make_shared<Node>(Node{value, head_.load()});
+        while (!head_.compare_exchange_weak(node->next, node)) {
+        }
+    }
+
+    std::optional<int> Pop() {
+        auto head = head_.load();
+        while (head && !head_.compare_exchange_weak(head, head->next)) {
+        }
+        return head ? std::optional(head->value) : std::nullopt;
+    }
+
+private:
+    struct Node {
+        int value;
+        std::shared_ptr<Node> next;
+    };
+
+    std::atomic<std::shared_ptr<Node>> head_;
+};
+
+static constexpr int kReclamationThreads = 32;
+static constexpr int kReclamationOps = 20'000;
+
+template <class Stack>
+static void PushPopOnThreads(Stack& stack) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kReclamationThreads; ++t) {
+        threads.emplace_back([&stack] {
+            for (int i = 0; i < kReclamationOps; ++i) {
+                stack.Push(i);
+                benchmark::DoNotOptimize(stack.Pop());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// 32 threads push and pop pairs on one stack. range(0): 0 - nodes are leaked, 1 - shared_ptr
+// nodes, 2 - EpochDomain from plain threads (hazard pointers), 3 - EpochDomain from 32 executor
+// workers (quiescent states), in tasks of 1000 pairs.
+static void BenchmarkReclamation(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor(kReclamationThreads);
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            LeakingStack stack;
+            PushPopOnThreads(stack);
+        } else if (state.range(0) == 1) {
+            SharedPtrStack stack;
+            PushPopOnThreads(stack);
+        } else if (state.range(0) == 2) {
+            LockFreeStack<int> stack;
+            PushPopOnThreads(stack);
+        } else {
+            LockFreeStack<int> stack;
+            std::vector<std::shared_ptr<Task>> tasks;
+            for (int t = 0; t < kReclamationThreads * kReclamationOps / 1000; ++t) {
+                auto task = MakeFunctionTask([&stack] {
+                    for (int i = 0; i < 1000; ++i) {
+                        stack.Push(i);
+                        benchmark::DoNotOptimize(stack.Pop());
+                    }
+                });
+                executor->Submit(task);
+                tasks.push_back(std::move(task));
+            }
+            for (auto& task : tasks) {
+                task->Wait();
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kReclamationThreads * kReclamationOps);
+}
+
+BENCHMARK(BenchmarkReclamation)
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(3)
+    ->Iterations(5)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Every worker of a fiber executor ends up with many tasks suspended in Wait at once. With guard
+// pages each stack takes two memory mappings, so the default vm.max_map_count of 65530 caps the
+// guarded runs at about 32k fibers; the 100k run uses small unguarded stacks.
+using SmallStackFiberExecutor =
+    BasicExecutor<FifoQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy, NoStatsPolicy,
+                  BasicFiberRunPolicy<16 << 10, false>>;
+
+template <class E>
+static void BenchmarkBlockedTasks(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor<E>(4);
+    const int64_t num_tasks = state.range(0);
+    for (auto _ : state) {
+        auto gate = MakeFunctionTask([] {});
+        std::atomic<int64_t> remaining{num_tasks};
+        for (int64_t i = 0; i < num_tasks; ++i) {
+            executor->Submit(MakeFunctionTask([&] {
+                gate->Wait();
+                if (remaining.fetch_sub(1) == 1) {
+                    remaining.notify_one();
+                }
+            }));
+        }
+        executor->Submit(gate);
+        for (auto left = remaining.load(); left != 0; left = remaining.load()) {
+            remaining.wait(left);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * num_tasks);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkBlockedTasks, FiberExecutor)
+    ->Arg(1'000)
+    ->Arg(30'000)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkBlockedTasks, SmallStackFiberExecutor)
+    ->Arg(30'000)
+    ->Arg(100'000)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Executor has one queue for everybody, so the target shard is only a hint for ShardedExecutor.
+static bool SubmitOn(Executor& executor, size_t, std::shared_ptr<Task> task) {
+    return executor.Submit(std::move(task));
+}
+
+static bool SubmitOn(ShardedExecutor& executor, size_t shard, std::shared_ptr<Task> task) {
+    return executor.SubmitTo(shard, std::move(task));
+}
+
+// One message bounces between two workers; time per round trip.
+template <class E>
+static void BenchmarkPingPong(benchmark::State& state) {
+    auto executor = std::make_shared<E>(2);
+    constexpr int kRoundTrips = 10'000;
+    for (auto _ : state) {
+        std::atomic<bool> done = false;
+        std::function<void(size_t, int)> bounce = [&](size_t shard, int left) {
+            if (left == 0) {
+                done = true;
+                done.notify_one();
+                return;
+            }
+            SubmitOn(*executor, 1 - shard,
+                     MakeFunctionTask([&bounce, shard, left] { bounce(1 - shard, left - 1); }));
+        };
+        SubmitOn(*executor, 0, MakeFunctionTask([&] { bounce(0, 2 * kRoundTrips); }));
+        done.wait(false);
+    }
+    state.SetItemsProcessed(state.iterations() * kRoundTrips);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkPingPong, Executor)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkPingPong, ShardedExecutor)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Every worker sends small tasks to all workers in turn; every worker receives as many as it sends.
+template <class E>
+static void BenchmarkShardedThroughput(benchmark::State& state) {
+    const size_t num_workers = state.range(0);
+    const int64_t per_worker = 8192 * num_workers;
+    auto executor = std::make_shared<E>(num_workers);
+    std::vector<CacheLinePadded<std::atomic<int64_t>>> received(num_workers);
+    for (auto _ : state) {
+        std::atomic<size_t> workers_left = num_workers;
+        for (auto& count : received) {
+            count.value = 0;
+        }
+        auto receive = [&](size_t to) {
+            if (received[to].value.fetch_add(1, std::memory_order_relaxed) + 1 == per_worker &&
+                workers_left.fetch_sub(1) == 1) {
+                workers_left.notify_one();
+            }
+        };
+        for (size_t from = 0; from < num_workers; ++from) {
+            SubmitOn(*executor, from, MakeFunctionTask([&, from] {
+                for (int64_t i = 0; i < per_worker; ++i) {
+                    size_t to = (from + 1 + i) % num_workers;
+                    SubmitOn(*executor, to, MakeFunctionTask([&, to] { receive(to); }));
+                }
+            }));
+        }
+        for (auto left = workers_left.load(); left != 0; left = workers_left.load()) {
+            workers_left.wait(left);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * per_worker * num_workers);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkShardedThroughput, Executor)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkShardedThroughput, ShardedExecutor)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+template <size_t kBatch>
+using BatchingExecutor = BasicExecutor<BatchingQueuePolicy<kBatch>, BlockingWaitPolicy,
+                                       DefaultAllocPolicy, NoStatsPolicy>;
+
+// A flood of empty tasks queued up front and drained by range(0) workers, so the workers mostly
+// compete for the queue lock with each other.
+template <class E>
+static void BenchmarkSubmitFlood(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor<E>(state.range(0));
+    constexpr int64_t kTasks = 200'000;
+    std::vector<std::shared_ptr<Task>> tasks(kTasks);
+    for (auto _ : state) {
+        std::atomic<int64_t> remaining{kTasks};
+        state.PauseTiming();
+        for (auto& task : tasks) {
+            task = std::make_shared<CountdownTask>(&remaining);
+        }
+        state.ResumeTiming();
+        for (auto& task : tasks) {
+            executor->Submit(std::move(task));
+        }
+        for (auto left = remaining.load(); left != 0; left = remaining.load()) {
+            remaining.wait(left);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kTasks);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkSubmitFlood, Executor)
+    ->RangeMultiplier(4)
+    ->Range(2, 32)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkSubmitFlood, BatchingExecutor<1>)
+    ->RangeMultiplier(4)
+    ->Range(2, 32)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkSubmitFlood, BatchingExecutor<8>)
+    ->RangeMultiplier(4)
+    ->Range(2, 32)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkSubmitFlood, BatchingExecutor<32>)
+    ->RangeMultiplier(4)
+    ->Range(2, 32)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+using RunNextExecutor =
+    BasicExecutor<RunNextQueuePolicy<>, BlockingWaitPolicy, DefaultAllocPolicy, NoStatsPolicy>;
+
+// A message handed down a chain of tasks, each submitting the next one.
+template <class E>
+static void BenchmarkMessageChain(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor<E>(state.range(0));
+    constexpr int kHops = 10'000;
+    for (auto _ : state) {
+        std::atomic<bool> done = false;
+        std::function<void(int)> hop = [&](int left) {
+            if (left == 0) {
+                done = true;
+                done.notify_one();
+                return;
+            }
+            executor->Submit(MakeFunctionTask([&hop, left] { hop(left - 1); }));
+        };
+        executor->Submit(MakeFunctionTask([&] { hop(kHops); }));
+        done.wait(false);
+    }
+    state.SetItemsProcessed(state.iterations() * kHops);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkMessageChain, Executor)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkMessageChain, RunNextExecutor)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// A producer fills a 64KB buffer and submits a consumer that sums it up, which submits the next
+// producer; the consumer is cheap when it runs where the buffer is still in cache.
+template <class E>
+static void BenchmarkProducerConsumer(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor<E>(state.range(0));
+    constexpr int kRounds = 1'000;
+    std::vector<int64_t> buffer(8192);
+    for (auto _ : state) {
+        std::atomic<bool> done = false;
+        int64_t sum = 0;
+        std::function<void(int)> produce = [&](int round) {
+            if (round == kRounds) {
+                done = true;
+                done.notify_one();
+                return;
+            }
+            std::iota(buffer.begin(), buffer.end(), round);
+            executor->Submit(MakeFunctionTask([&, round] {
+                sum += std::accumulate(buffer.begin(), buffer.end(), int64_t{0});
+                executor->Submit(MakeFunctionTask([&produce, round] { produce(round + 1); }));
+            }));
+        };
+        executor->Submit(MakeFunctionTask([&] { produce(0); }));
+        done.wait(false);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * kRounds);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkProducerConsumer, Executor)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkProducerConsumer, RunNextExecutor)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+using LocalExecutor =
+    BasicExecutor<LocalQueuePolicy<>, BlockingWaitPolicy, DefaultAllocPolicy, NoStatsPolicy>;
+
+// Last level cache misses of the calling thread and the threads it creates afterwards, through
+// perf_event_open. Not available in every environment.
+class LlcMissCounter {
+public:
+    LlcMissCounter() {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    LlcMissCounter(const LlcMissCounter&) = delete;
+    LlcMissCounter& operator=(const LlcMissCounter&) = delete;
+
+    ~LlcMissCounter() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool IsAvailable() const {
+        return fd_ >= 0;
+    }
+
+    // With inherit set, the count includes the children that have exited only.
+    int64_t Read() const {
+        int64_t value = 0;
+        if (fd_ < 0 || read(fd_, &value, sizeof(value)) != sizeof(value)) {
+            return -1;
+        }
+        return value;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+// A Then chain whose stages each read the 64KB result of the previous one and produce the next.
+template <class E>
+static void BenchmarkThenChainLocality(benchmark::State& state) {
+    constexpr int kStages = 256;
+    constexpr size_t kBytes = 64 << 10;
+    LlcMissCounter misses;
+    int64_t before = misses.Read();
+    {
+        auto executor = MakeThreadPoolExecutor<E>(state.range(0));
+        for (auto _ : state) {
+            auto stage = executor->template Invoke<std::vector<char>>(
+                [] { return std::vector<char>(kBytes, 1); });
+            for (int i = 0; i < kStages; ++i) {
+                stage = executor->template Then<std::vector<char>>(stage, [stage] {
+                    auto input = stage->Get();
+                    for (auto& byte : input) {
+                        byte = static_cast<char>(byte * 3 + 1);
+                    }
+                    return input;
+                });
+            }
+            benchmark::DoNotOptimize(stage->Get());
+        }
+    }
+    // The workers have exited, so their misses are included.
+    if (misses.IsAvailable()) {
+        state.counters["llc_misses_per_stage"] =
+            static_cast<double>(misses.Read() - before) / (state.iterations() * kStages);
+    }
+    state.SetItemsProcessed(state.iterations() * kStages);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkThenChainLocality, Executor)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkThenChainLocality, LocalExecutor)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+template <class Placement>
+using DistributedExecutor = BasicExecutor<DistributedQueuePolicy<Placement>, BlockingWaitPolicy,
+                                          DefaultAllocPolicy, NoStatsPolicy>;
+
+// range(0) workers run tasks submitted from the benchmark thread, one in 16 of them 50 times
+// longer than the others. Reports the 99th percentile of the time tasks wait in a queue.
+template <class E>
+static void BenchmarkSkewedPlacement(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor<E>(state.range(0));
+    constexpr int64_t kTasks = 20'000;
+    std::vector<double> waits(kTasks);
+    std::mt19937 gen(42);
+    double p99_us = 0;
+    for (auto _ : state) {
+        std::atomic<int64_t> remaining{kTasks};
+        for (int64_t i = 0; i < kTasks; ++i) {
+            auto duration = std::chrono::microseconds(gen() % 16 == 0 ? 100 : 2);
+            executor->Submit(MakeFunctionTask(
+                [&waits, &remaining, i, duration, submitted = std::chrono::steady_clock::now()] {
+                    waits[i] = MicrosecondsSince(submitted);
+                    SpinFor(duration);
+                    if (remaining.fetch_sub(1) == 1) {
+                        remaining.notify_one();
+                    }
+                }));
+        }
+        for (auto left = remaining.load(); left != 0; left = remaining.load()) {
+            remaining.wait(left);
+        }
+        std::nth_element(waits.begin(), waits.begin() + kTasks * 99 / 100, waits.end());
+        p99_us += waits[kTasks * 99 / 100];
+    }
+    state.counters["p99_wait_us"] =
+        benchmark::Counter(p99_us, benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations() * kTasks);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkSkewedPlacement, Executor)
+    ->Arg(2)
+    ->Arg(8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkSkewedPlacement, DistributedExecutor<RandomPlacement>)
+    ->Arg(2)
+    ->Arg(8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkSkewedPlacement, DistributedExecutor<RoundRobinPlacement>)
+    ->Arg(2)
+    ->Arg(8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkSkewedPlacement, DistributedExecutor<TwoChoicesPlacement>)
+    ->Arg(2)
+    ->Arg(8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+using PriorityExecutor =
+    BasicExecutor<PriorityQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy, NoStatsPolicy>;
+
+// PriorityQueuePolicy without Reprioritize: tasks are ordered by priority, but dependencies do not
+// inherit it.
+class NoInheritancePriorityQueuePolicy : private PriorityQueuePolicy {
+public:
+    using PriorityQueuePolicy::Close;
+    using PriorityQueuePolicy::IsClosed;
+    using PriorityQueuePolicy::Push;
+    using PriorityQueuePolicy::TryPop;
+};
+
+using NoInheritancePriorityExecutor = BasicExecutor<NoInheritancePriorityQueuePolicy,
+                                                    BlockingWaitPolicy, DefaultAllocPolicy,
+                                                    NoStatsPolicy>;
+
+// Bulk low priority tasks, among them the inputs of a high priority root submitted last. Reports
+// the time from submitting the root until it has run.
+template <class E>
+static void BenchmarkPriorityRootLatency(benchmark::State& state) {
+    auto executor = MakeThreadPoolExecutor<E>(state.range(0));
+    constexpr int kBulk = 2'000;
+    constexpr int kInputs = 4;
+    for (auto _ : state) {
+        std::vector<std::shared_ptr<Task>> tasks;
+        for (int i = 0; i < kBulk; ++i) {
+            tasks.push_back(MakeFunctionTask([] { SpinFor(std::chrono::microseconds(5)); }));
+        }
+        std::chrono::steady_clock::time_point finished;
+        auto root = MakeFunctionTask([&finished] { finished = std::chrono::steady_clock::now(); });
+        root->SetPriority(10);
+        // Inputs shared with the bulk work, spread over its second half.
+        for (int i = 0; i < kInputs; ++i) {
+            root->AddDependency(tasks[kBulk / 2 + i * kBulk / (2 * kInputs)]);
+        }
+        for (auto& task : tasks) {
+            executor->Submit(task);
+        }
+        auto start = std::chrono::steady_clock::now();
+        executor->Submit(root);
+        root->Wait();
+        // Taken by the root itself: the benchmark thread may wake up late with many workers.
+        state.SetIterationTime(std::chrono::duration<double>(finished - start).count());
+        for (auto& task : tasks) {
+            task->Wait();
+        }
+    }
+}
+
+BENCHMARK_TEMPLATE(BenchmarkPriorityRootLatency, Executor)
+    ->Arg(2)
+    ->Arg(8)
+    ->UseManualTime()
+    ->Iterations(100)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BenchmarkPriorityRootLatency, NoInheritancePriorityExecutor)
+    ->Arg(2)
+    ->Arg(8)
+    ->UseManualTime()
+    ->Iterations(100)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BenchmarkPriorityRootLatency, PriorityExecutor)
+    ->Arg(2)
+    ->Arg(8)
+    ->UseManualTime()
+    ->Iterations(100)
+    ->Unit(benchmark::kMicrosecond);
+
+// Random layered DAG of range(0) tasks, 64 per layer, each depending on up to three tasks of the
+// previous layer. One task in 8 costs 10 times more than the others. Tasks sleep for their cost,
+// so 32 workers overlap as if they had a core each. Reports the makespan of the graph next to its
+// critical path, the lower bound for any schedule.
+template <class E>
+static void BenchmarkRandomDagMakespan(benchmark::State& state) {
+    constexpr size_t kWidth = 64;
+    constexpr int kWorkers = 32;
+    auto executor = MakeThreadPoolExecutor<E>(kWorkers);
+    size_t size = state.range(0);
+    std::mt19937 gen(42);
+    double critical_path_ms = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::vector<std::shared_ptr<Task>> graph;
+        std::vector<double> costs;
+        std::vector<double> finish(size);
+        for (size_t i = 0; i < size; ++i) {
+            auto cost = std::chrono::microseconds(gen() % 8 == 0 ? 4000 : 400);
+            graph.push_back(MakeFunctionTask([cost] { std::this_thread::sleep_for(cost); }));
+            costs.push_back(cost.count());
+            double start = 0;
+            if (size_t layer_begin = i / kWidth * kWidth; layer_begin >= kWidth) {
+                for (int edge = gen() % 3; edge >= 0; --edge) {
+                    size_t dep = layer_begin - kWidth + gen() % kWidth;
+                    graph.back()->AddDependency(graph[dep]);
+                    start = std::max(start, finish[dep]);
+                }
+            }
+            finish[i] = start + costs.back();
+        }
+        critical_path_ms += *std::max_element(finish.begin(), finish.end()) / 1000;
+        state.ResumeTiming();
+
+        executor->SubmitGraph(graph, costs);
+        for (auto& task : graph) {
+            task->Wait();
+        }
+    }
+    state.counters["critical_path_ms"] =
+        benchmark::Counter(critical_path_ms, benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK_TEMPLATE(BenchmarkRandomDagMakespan, Executor)
+    ->Arg(1'000)
+    ->Arg(10'000)
+    ->Arg(100'000)
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BenchmarkRandomDagMakespan, PriorityExecutor)
+    ->Arg(1'000)
+    ->Arg(10'000)
+    ->Arg(100'000)
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
 BENCHMARK_MAIN();
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+inline constexpr size_t kCacheLineSize = 64;
+
+// Keeps a value alone on its cache line, so that neighbouring slots written by different
+// threads do not false-share.
+template <class T>
+struct alignas(kCacheLineSize) CacheLinePadded {
+    T value{};
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+inline constexpr size_t kNoWorker = static_cast<size_t>(-1);
+
+namespace detail {
+
+struct CurrentWorker {
+    const void* executor = nullptr;
+    size_t index = kNoWorker;
+};
+
+inline thread_local CurrentWorker current_worker;
+
+}  // namespace detail
+
+// Index of the calling thread among the workers of its executor, from 0 to NumThreads() - 1, or
+// kNoWorker if the calling thread is not a worker.
+inline size_t CurrentWorkerIndex() {
+    return detail::current_worker.index;
+}
+
+// True if the calling thread is one of the workers of `executor`.
+template <class E>
+bool IsWorkerOf(const E& executor) {
+    return detail::current_worker.executor == &executor;
+}
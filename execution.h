@@ -0,0 +1,649 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <executors.h>
+
+// Lazy sender/receiver pipelines in the spirit of P2300.
+//
+// A sender describes work without starting it. Connecting a sender to a receiver produces an
+// operation state, and nothing happens until Start() is called on it. Adaptors such as Then and
+// Bulk do not have operation states of their own: they wrap the downstream receiver and forward
+// Connect to their predecessor, so a whole pipeline collapses into one object whose size is known
+// at compile time and which lives wherever the caller puts it, usually on the stack of SyncWait.
+//
+//     auto result = execution::SyncWait(execution::Schedule(*pool)
+//                                       | execution::Then([] { return 1; })
+//                                       | execution::Then([](int x) { return x + 1; }));
+//
+// Stages run inline on the thread that completed the previous stage. The only points that touch the
+// executor queue are Schedule and FromFuture.
+//
+// Every sender completes with exactly one value of type ValueType, or with an error, or stopped.
+// Receivers implement SetValue(ValueType), SetError(std::exception_ptr) and SetStopped().
+namespace execution {
+
+namespace detail {
+
+template <class T>
+using Lift = std::conditional_t<std::is_void_v<T>, Unit, T>;
+
+// Calls f with the value, or without arguments when the value is Unit and f does not take it.
+template <class F, class V>
+decltype(auto) InvokeWithValue(F& f, V&& value) {
+    if constexpr (std::is_same_v<std::decay_t<V>, Unit> && std::is_invocable_v<F&>) {
+        return f();
+    } else {
+        return f(std::forward<V>(value));
+    }
+}
+
+template <class F, class V>
+using InvokeResult = decltype(InvokeWithValue(std::declval<F&>(), std::declval<V>()));
+
+}  // namespace detail
+
+template <class S>
+using ValueTypeOf = typename std::decay_t<S>::ValueType;
+
+template <class S, class R>
+using ConnectResult = decltype(std::declval<S>().Connect(std::declval<R>()));
+
+// Schedule ---------------------------------------------------------------------------------------
+
+template <class R>
+class ScheduleOperation {
+public:
+    ScheduleOperation(Executor* executor, R receiver)
+        : executor_(executor), receiver_(std::move(receiver)) {
+    }
+
+    ScheduleOperation(const ScheduleOperation&) = delete;
+    ScheduleOperation& operator=(const ScheduleOperation&) = delete;
+
+    void Start() {
+        // The hop is the only heap allocation of a pipeline: the executor keeps its task alive
+        // until after Run() returns, while this operation may be gone by then.
+        if (!executor_->Submit(std::make_shared<HopTask>(this))) {
+            receiver_.SetStopped();
+        }
+    }
+
+private:
+    class HopTask : public Task {
+    public:
+        explicit HopTask(ScheduleOperation* op) : op_(op) {
+        }
+
+        void Run() override {
+            op_->receiver_.SetValue(Unit{});
+        }
+
+    private:
+        ScheduleOperation* op_;
+    };
+
+    Executor* executor_;
+    R receiver_;
+};
+
+class ScheduleSender {
+public:
+    using ValueType = Unit;
+
+    explicit ScheduleSender(Executor* executor) : executor_(executor) {
+    }
+
+    template <class R>
+    ScheduleOperation<R> Connect(R receiver) && {
+        return ScheduleOperation<R>(executor_, std::move(receiver));
+    }
+
+private:
+    Executor* executor_;
+};
+
+// Completes with Unit on one of the executor threads.
+inline ScheduleSender Schedule(Executor& executor) {
+    return ScheduleSender(&executor);
+}
+
+// Just -------------------------------------------------------------------------------------------
+
+template <class T, class R>
+class JustOperation {
+public:
+    JustOperation(T value, R receiver) : value_(std::move(value)), receiver_(std::move(receiver)) {
+    }
+
+    JustOperation(const JustOperation&) = delete;
+    JustOperation& operator=(const JustOperation&) = delete;
+
+    void Start() {
+        receiver_.SetValue(std::move(value_));
+    }
+
+private:
+    T value_;
+    R receiver_;
+};
+
+template <class T>
+class JustSender {
+public:
+    using ValueType = T;
+
+    explicit JustSender(T value) : value_(std::move(value)) {
+    }
+
+    template <class R>
+    JustOperation<T, R> Connect(R receiver) && {
+        return JustOperation<T, R>(std::move(value_), std::move(receiver));
+    }
+
+private:
+    T value_;
+};
+
+// Completes inline with the given value.
+template <class T>
+JustSender<std::decay_t<T>> Just(T&& value) {
+    return JustSender<std::decay_t<T>>(std::forward<T>(value));
+}
+
+// Then -------------------------------------------------------------------------------------------
+
+template <class R, class F, class V>
+class ThenReceiver {
+public:
+    ThenReceiver(R receiver, F fn) : receiver_(std::move(receiver)), fn_(std::move(fn)) {
+    }
+
+    void SetValue(V value) {
+        using Result = detail::InvokeResult<F, V>;
+        if constexpr (std::is_void_v<Result>) {
+            try {
+                detail::InvokeWithValue(fn_, std::move(value));
+            } catch (...) {
+                receiver_.SetError(std::current_exception());
+                return;
+            }
+            receiver_.SetValue(Unit{});
+        } else {
+            std::optional<Result> result;
+            try {
+                result.emplace(detail::InvokeWithValue(fn_, std::move(value)));
+            } catch (...) {
+                receiver_.SetError(std::current_exception());
+                return;
+            }
+            receiver_.SetValue(std::move(*result));
+        }
+    }
+
+    void SetError(std::exception_ptr e_ptr) {
+        receiver_.SetError(e_ptr);
+    }
+
+    void SetStopped() {
+        receiver_.SetStopped();
+    }
+
+private:
+    R receiver_;
+    F fn_;
+};
+
+template <class S, class F>
+class ThenSender {
+public:
+    using ValueType = detail::Lift<detail::InvokeResult<F, ValueTypeOf<S>>>;
+
+    ThenSender(S sender, F fn) : sender_(std::move(sender)), fn_(std::move(fn)) {
+    }
+
+    template <class R>
+    auto Connect(R receiver) && {
+        return std::move(sender_).Connect(
+            ThenReceiver<R, F, ValueTypeOf<S>>(std::move(receiver), std::move(fn_)));
+    }
+
+private:
+    S sender_;
+    F fn_;
+};
+
+template <class F>
+struct ThenClosure {
+    F fn;
+};
+
+// Transforms the value with fn, inline on the thread that produced it.
+template <class F>
+ThenClosure<std::decay_t<F>> Then(F&& fn) {
+    return {std::forward<F>(fn)};
+}
+
+template <class S, class F>
+ThenSender<std::decay_t<S>, F> operator|(S&& sender, ThenClosure<F> closure) {
+    return {std::forward<S>(sender), std::move(closure.fn)};
+}
+
+// Bulk -------------------------------------------------------------------------------------------
+
+template <class R, class F, class V>
+class BulkReceiver {
+public:
+    BulkReceiver(R receiver, size_t count, F fn)
+        : receiver_(std::move(receiver)), count_(count), fn_(std::move(fn)) {
+    }
+
+    void SetValue(V value) {
+        try {
+            for (size_t i = 0; i < count_; ++i) {
+                if constexpr (std::is_same_v<V, Unit> && std::is_invocable_v<F&, size_t>) {
+                    fn_(i);
+                } else {
+                    fn_(i, value);
+                }
+            }
+        } catch (...) {
+            receiver_.SetError(std::current_exception());
+            return;
+        }
+        receiver_.SetValue(std::move(value));
+    }
+
+    void SetError(std::exception_ptr e_ptr) {
+        receiver_.SetError(e_ptr);
+    }
+
+    void SetStopped() {
+        receiver_.SetStopped();
+    }
+
+private:
+    R receiver_;
+    size_t count_;
+    F fn_;
+};
+
+template <class S, class F>
+class BulkSender {
+public:
+    using ValueType = ValueTypeOf<S>;
+
+    BulkSender(S sender, size_t count, F fn)
+        : sender_(std::move(sender)), count_(count), fn_(std::move(fn)) {
+    }
+
+    template <class R>
+    auto Connect(R receiver) && {
+        return std::move(sender_).Connect(
+            BulkReceiver<R, F, ValueType>(std::move(receiver), count_, std::move(fn_)));
+    }
+
+private:
+    S sender_;
+    size_t count_;
+    F fn_;
+};
+
+template <class F>
+struct BulkClosure {
+    size_t count;
+    F fn;
+};
+
+// Calls fn(i, value) for i in [0, count) and passes the value on. Like the default bulk of P2300
+// the iterations run inline one after another; fan out with WhenAll of scheduled senders instead.
+template <class F>
+BulkClosure<std::decay_t<F>> Bulk(size_t count, F&& fn) {
+    return {count, std::forward<F>(fn)};
+}
+
+template <class S, class F>
+BulkSender<std::decay_t<S>, F> operator|(S&& sender, BulkClosure<F> closure) {
+    return {std::forward<S>(sender), closure.count, std::move(closure.fn)};
+}
+
+// WhenAll ----------------------------------------------------------------------------------------
+
+template <class R, class... Senders>
+class WhenAllOperation;
+
+namespace detail {
+
+template <class Parent, size_t I>
+class WhenAllReceiver {
+public:
+    explicit WhenAllReceiver(Parent* parent) : parent_(parent) {
+    }
+
+    template <class V>
+    void SetValue(V&& value) {
+        std::get<I>(parent_->values_).emplace(std::forward<V>(value));
+        parent_->Arrive();
+    }
+
+    void SetError(std::exception_ptr e_ptr) {
+        if (!parent_->failed_.exchange(true)) {
+            parent_->error_ = e_ptr;
+        }
+        parent_->Arrive();
+    }
+
+    void SetStopped() {
+        parent_->stopped_ = true;
+        parent_->Arrive();
+    }
+
+private:
+    Parent* parent_;
+};
+
+// Child operation states are members initialized from prvalues, so they are constructed in place
+// and never moved.
+template <class Parent, size_t I, class S>
+struct WhenAllChild {
+    WhenAllChild(S&& sender, Parent* parent)
+        : op(std::move(sender).Connect(WhenAllReceiver<Parent, I>(parent))) {
+    }
+
+    ConnectResult<S, WhenAllReceiver<Parent, I>> op;
+};
+
+template <class Parent, class Indices, class... Senders>
+struct WhenAllChildren;
+
+template <class Parent, size_t... Is, class... Senders>
+struct WhenAllChildren<Parent, std::index_sequence<Is...>, Senders...>
+    : WhenAllChild<Parent, Is, Senders>... {
+    WhenAllChildren(Parent* parent, Senders&&... senders)
+        : WhenAllChild<Parent, Is, Senders>(std::move(senders), parent)... {
+    }
+
+    void Start() {
+        (WhenAllChild<Parent, Is, Senders>::op.Start(), ...);
+    }
+};
+
+}  // namespace detail
+
+template <class R, class... Senders>
+class WhenAllOperation {
+public:
+    WhenAllOperation(R receiver, Senders&&... senders)
+        : receiver_(std::move(receiver)), children_(this, std::move(senders)...) {
+    }
+
+    WhenAllOperation(const WhenAllOperation&) = delete;
+    WhenAllOperation& operator=(const WhenAllOperation&) = delete;
+
+    void Start() {
+        children_.Start();
+    }
+
+private:
+    template <class, size_t>
+    friend class detail::WhenAllReceiver;
+
+    void Arrive() {
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        if (failed_.load()) {
+            receiver_.SetError(error_);
+        } else if (stopped_.load()) {
+            receiver_.SetStopped();
+        } else {
+            receiver_.SetValue(std::apply(
+                [](auto&... values) { return std::tuple(std::move(*values)...); }, values_));
+        }
+    }
+
+    R receiver_;
+    std::tuple<std::optional<ValueTypeOf<Senders>>...> values_;
+    std::atomic<size_t> remaining_{sizeof...(Senders)};
+    std::atomic<bool> failed_{false};
+    std::atomic<bool> stopped_{false};
+    std::exception_ptr error_;
+    detail::WhenAllChildren<WhenAllOperation, std::index_sequence_for<Senders...>, Senders...>
+        children_;
+};
+
+template <class... Senders>
+class WhenAllSender {
+public:
+    using ValueType = std::tuple<ValueTypeOf<Senders>...>;
+
+    explicit WhenAllSender(Senders... senders) : senders_(std::move(senders)...) {
+    }
+
+    template <class R>
+    WhenAllOperation<R, Senders...> Connect(R receiver) && {
+        return std::apply(
+            [&](Senders&... senders) {
+                return WhenAllOperation<R, Senders...>(std::move(receiver), std::move(senders)...);
+            },
+            senders_);
+    }
+
+private:
+    std::tuple<Senders...> senders_;
+};
+
+// Starts all senders and completes with a tuple of their values once every one of them is done.
+// The first error wins over stopped, stopped wins over values.
+template <class... Senders>
+WhenAllSender<std::decay_t<Senders>...> WhenAll(Senders&&... senders) {
+    static_assert(sizeof...(Senders) > 0);
+    return WhenAllSender<std::decay_t<Senders>...>(std::forward<Senders>(senders)...);
+}
+
+// FromFuture -------------------------------------------------------------------------------------
+
+template <class T, class R>
+class FromFutureOperation {
+public:
+    FromFutureOperation(Executor* executor, FuturePtr<T> future, R receiver)
+        : executor_(executor), future_(std::move(future)), receiver_(std::move(receiver)) {
+    }
+
+    FromFutureOperation(const FromFutureOperation&) = delete;
+    FromFutureOperation& operator=(const FromFutureOperation&) = delete;
+
+    void Start() {
+        auto continuation = std::make_shared<Continuation>(this);
+        continuation->AddDependency(future_);
+        if (!executor_->Submit(std::move(continuation))) {
+            receiver_.SetStopped();
+        }
+    }
+
+private:
+    class Continuation : public Task {
+    public:
+        explicit Continuation(FromFutureOperation* op) : op_(op) {
+        }
+
+        void Run() override {
+            auto& future = op_->future_;
+            if (future->IsCanceled()) {
+                op_->receiver_.SetStopped();
+            } else if (future->IsFailed()) {
+                op_->receiver_.SetError(future->GetError());
+            } else {
+                op_->receiver_.SetValue(future->Get());
+            }
+        }
+
+    private:
+        FromFutureOperation* op_;
+    };
+
+    Executor* executor_;
+    FuturePtr<T> future_;
+    R receiver_;
+};
+
+template <class T>
+class FromFutureSender {
+public:
+    using ValueType = T;
+
+    FromFutureSender(Executor* executor, FuturePtr<T> future)
+        : executor_(executor), future_(std::move(future)) {
+    }
+
+    template <class R>
+    FromFutureOperation<T, R> Connect(R receiver) && {
+        return FromFutureOperation<T, R>(executor_, std::move(future_), std::move(receiver));
+    }
+
+private:
+    Executor* executor_;
+    FuturePtr<T> future_;
+};
+
+// Completes on the executor once the future is finished.
+template <class T>
+FromFutureSender<T> FromFuture(Executor& executor, FuturePtr<T> future) {
+    return FromFutureSender<T>(&executor, std::move(future));
+}
+
+// ToFuture ---------------------------------------------------------------------------------------
+
+namespace detail {
+
+// Owns the operation state of a detached pipeline. The receiver holds a reference to the future
+// until the pipeline completes, so dropping the returned FuturePtr does not tear down running work.
+template <class S>
+class SenderFuture : public Future<ValueTypeOf<S>> {
+    using T = ValueTypeOf<S>;
+
+    class Receiver {
+    public:
+        explicit Receiver(SenderFuture* future) : future_(future) {
+        }
+
+        void SetValue(T value) {
+            auto self = std::move(future_->self_);
+            self->SetValue(std::move(value));
+        }
+
+        void SetError(std::exception_ptr e_ptr) {
+            auto self = std::move(future_->self_);
+            self->SetError(e_ptr);
+        }
+
+        void SetStopped() {
+            auto self = std::move(future_->self_);
+            self->Cancel();
+        }
+
+    private:
+        SenderFuture* future_;
+    };
+
+public:
+    explicit SenderFuture(S&& sender) : op_(std::move(sender).Connect(Receiver(this))) {
+    }
+
+    void Start(std::shared_ptr<SenderFuture> self) {
+        self_ = std::move(self);
+        op_.Start();
+    }
+
+private:
+    std::shared_ptr<SenderFuture> self_;
+    ConnectResult<S, Receiver> op_;
+};
+
+}  // namespace detail
+
+// Starts the pipeline and exposes its result as a Future. Stopped pipelines cancel the future.
+template <class S>
+FuturePtr<ValueTypeOf<S>> ToFuture(S&& sender) {
+    using Holder = detail::SenderFuture<std::decay_t<S>>;
+    std::decay_t<S> owned = std::forward<S>(sender);
+    auto future = std::make_shared<Holder>(std::move(owned));
+    future->Start(future);
+    return future;
+}
+
+// SyncWait ---------------------------------------------------------------------------------------
+
+namespace detail {
+
+template <class T>
+struct SyncWaitState {
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    bool done = false;
+    std::optional<T> value;
+    std::exception_ptr error;
+};
+
+template <class T>
+class SyncWaitReceiver {
+public:
+    explicit SyncWaitReceiver(SyncWaitState<T>* state) : state_(state) {
+    }
+
+    void SetValue(T value) {
+        std::unique_lock lock(state_->mutex);
+        state_->value.emplace(std::move(value));
+        Finish();
+    }
+
+    void SetError(std::exception_ptr e_ptr) {
+        std::unique_lock lock(state_->mutex);
+        state_->error = e_ptr;
+        Finish();
+    }
+
+    void SetStopped() {
+        std::unique_lock lock(state_->mutex);
+        Finish();
+    }
+
+private:
+    // Notifies under the lock: the waiter destroys the state as soon as it observes `done`.
+    void Finish() {
+        state_->done = true;
+        state_->done_cv.notify_all();
+    }
+
+    SyncWaitState<T>* state_;
+};
+
+}  // namespace detail
+
+// Starts the pipeline and blocks until it completes. Returns nullopt if it was stopped and
+// rethrows its error. Must not be called from a worker of the executor the pipeline runs on.
+template <class S>
+std::optional<ValueTypeOf<S>> SyncWait(S&& sender) {
+    using T = ValueTypeOf<S>;
+    detail::SyncWaitState<T> state;
+    auto op = std::decay_t<S>(std::forward<S>(sender)).Connect(detail::SyncWaitReceiver<T>(&state));
+    op.Start();
+
+    std::unique_lock lock(state.mutex);
+    state.done_cv.wait(lock, [&] { return state.done; });
+    if (state.error) {
+        std::rethrow_exception(state.error);
+    }
+    return std::move(state.value);
+}
+
+}  // namespace execution
@@ -0,0 +1,723 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cache_line.h>
+#include <current_worker.h>
+
+class Task;
+
+// Building blocks of BasicExecutor. The executor holds one object of every policy by value and
+// calls it directly, so a combination is fixed at compile time and nothing is dispatched virtually.
+//
+// QueuePolicy stores submitted tasks:
+//     bool Push(std::shared_ptr<Task> task);  // false once closed
+//     std::shared_ptr<Task> TryPop();         // null if empty
+//     void Close();                           // queued tasks can still be popped
+//     bool IsClosed();
+// and may have
+//     void Attach(const void* executor, size_t num_workers);  // called before the workers start
+//     void Requeue(std::shared_ptr<Task> task);  // a popped task that is not ready yet, else Push
+//     size_t PushTo(size_t worker, std::shared_ptr<Task> task);  // preferably for `worker`,
+//                                   // returns how many tasks its queue holds now, 0 once closed
+//     void Reprioritize(std::shared_ptr<Task> task);  // a queued task got a higher priority
+// With Reprioritize, pending dependencies inherit the priority of the tasks submitted after them.
+// The executor then drops an entry of a task that was popped through another entry already.
+//
+// WaitPolicy parks idle workers. A worker takes a key, looks into the queue once more and waits
+// with the key if it is still empty; a notification issued after the key was taken ends the wait:
+//     uint64_t PrepareWait();
+//     void Wait(uint64_t key);
+//     void NotifyOne();
+//     void NotifyAll();
+//
+// AllocPolicy creates the futures the executor makes itself in Invoke, Then and the combinators:
+//     template <class T, class... Args> std::shared_ptr<T> Make(Args&&... args);
+//
+// StatsPolicy is told about every accepted submit, run, requeue of a task that was not ready yet
+// and failed run:
+//     void OnSubmit(); void OnRun(); void OnRequeue(); void OnFailure();
+//
+// RunPolicy decides where a task the worker has claimed runs. `execute` runs the task body and
+// completes the task; it never throws:
+//     template <class E, class F> void Run(E& executor, std::shared_ptr<Task> task, F execute);
+
+class FifoQueuePolicy {
+public:
+    bool Push(std::shared_ptr<Task> task) {
+        std::lock_guard guard(mutex_);
+        if (closed_) {
+            return false;
+        }
+        tasks_.push_back(std::move(task));
+        return true;
+    }
+
+    std::shared_ptr<Task> TryPop() {
+        std::lock_guard guard(mutex_);
+        if (tasks_.empty()) {
+            return nullptr;
+        }
+        auto task = std::move(tasks_.front());
+        tasks_.pop_front();
+        return task;
+    }
+
+    void Close() {
+        std::lock_guard guard(mutex_);
+        closed_ = true;
+    }
+
+    bool IsClosed() {
+        std::lock_guard guard(mutex_);
+        return closed_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<std::shared_ptr<Task>> tasks_;
+    bool closed_ = false;
+};
+
+// Runs tasks by Task::Priority, highest first and in submission order within a priority. A task
+// whose priority was raised while it waited is queued once more; its old entry stays behind and is
+// dropped by the executor when popped. Low priority tasks wait as long as there are higher ones.
+class PriorityQueuePolicy {
+public:
+    bool Push(std::shared_ptr<Task> task);
+
+    void Reprioritize(std::shared_ptr<Task> task) {
+        Push(std::move(task));
+    }
+
+    std::shared_ptr<Task> TryPop() {
+        std::lock_guard guard(mutex_);
+        for (size_t word = kWords; word-- > 0;) {
+            if (uint64_t bits = occupied_[word]) {
+                size_t level = word * 64 + 63 - std::countl_zero(bits);
+                auto& tasks = levels_[level];
+                auto task = std::move(tasks.front());
+                tasks.pop_front();
+                if (tasks.empty()) {
+                    occupied_[word] &= ~(uint64_t{1} << level % 64);
+                }
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void Close() {
+        std::lock_guard guard(mutex_);
+        closed_ = true;
+    }
+
+    bool IsClosed() {
+        std::lock_guard guard(mutex_);
+        return closed_;
+    }
+
+private:
+    static constexpr size_t kLevels = 256;
+    static constexpr size_t kWords = kLevels / 64;
+
+    std::mutex mutex_;
+    std::array<std::deque<std::shared_ptr<Task>>, kLevels> levels_;
+    // Bit per level that has tasks.
+    std::array<uint64_t, kWords> occupied_{};
+    bool closed_ = false;
+};
+
+// Workers take up to kMaxBatch tasks per lock of the shared queue: one to run and the rest into a
+// buffer of their own, which they drain before they come back. A batch is the queue length split
+// evenly among the workers, so a short queue still spreads over all of them. Buffered tasks can be
+// stolen: a worker that finds the shared queue empty takes from the other buffers instead of going
+// to sleep, so tasks are not stuck behind a long one. A sleeping worker is not woken for them.
+template <size_t kMaxBatch>
+class BatchingQueuePolicy {
+    static_assert(kMaxBatch > 0);
+
+public:
+    void Attach(const void* executor, size_t num_workers) {
+        executor_ = executor;
+        buffers_ = std::vector<CacheLinePadded<Buffer>>(num_workers);
+    }
+
+    bool Push(std::shared_ptr<Task> task) {
+        std::lock_guard guard(mutex_);
+        if (closed_) {
+            return false;
+        }
+        tasks_.push_back(std::move(task));
+        return true;
+    }
+
+    std::shared_ptr<Task> TryPop() {
+        size_t self = detail::current_worker.index;
+        if (detail::current_worker.executor != executor_) {
+            return TryPopShared(nullptr);
+        }
+        if (auto task = TryPopBuffer(buffers_[self].value)) {
+            return task;
+        }
+        if (auto task = TryPopShared(&buffers_[self].value)) {
+            return task;
+        }
+        for (size_t i = 1; i < buffers_.size(); ++i) {
+            if (auto task = TryPopBuffer(buffers_[(self + i) % buffers_.size()].value)) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void Close() {
+        std::lock_guard guard(mutex_);
+        closed_ = true;
+    }
+
+    bool IsClosed() {
+        std::lock_guard guard(mutex_);
+        return closed_;
+    }
+
+private:
+    struct Buffer {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Task>> tasks;
+        // Lets owners and thieves skip an empty buffer without locking it.
+        std::atomic<size_t> size = 0;
+    };
+
+    static std::shared_ptr<Task> TryPopBuffer(Buffer& buffer) {
+        if (buffer.size.load(std::memory_order_relaxed) == 0) {
+            return nullptr;
+        }
+        std::lock_guard guard(buffer.mutex);
+        if (buffer.tasks.empty()) {
+            return nullptr;
+        }
+        auto task = std::move(buffer.tasks.front());
+        buffer.tasks.pop_front();
+        buffer.size.store(buffer.tasks.size(), std::memory_order_relaxed);
+        return task;
+    }
+
+    std::shared_ptr<Task> TryPopShared(Buffer* buffer) {
+        std::lock_guard guard(mutex_);
+        if (tasks_.empty()) {
+            return nullptr;
+        }
+        auto task = std::move(tasks_.front());
+        tasks_.pop_front();
+        if (!buffer) {
+            return task;
+        }
+        size_t batch = std::min(tasks_.size() / buffers_.size(), kMaxBatch - 1);
+        if (batch) {
+            std::lock_guard buffer_guard(buffer->mutex);
+            for (size_t i = 0; i < batch; ++i) {
+                buffer->tasks.push_back(std::move(tasks_.front()));
+                tasks_.pop_front();
+            }
+            buffer->size.store(buffer->tasks.size(), std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    std::mutex mutex_;
+    std::deque<std::shared_ptr<Task>> tasks_;
+    bool closed_ = false;
+    const void* executor_ = nullptr;
+    std::vector<CacheLinePadded<Buffer>> buffers_;
+};
+
+// Wraps another queue with a "run next" slot per worker. A task that a worker of the executor
+// submits goes into the slot of that worker and runs right after the current task, while its
+// inputs are still in cache; the task it displaces moves on to the inner queue. Other workers only
+// steal from a slot once the task has waited there for kMaxSlotAge, and every kFairnessInterval-th
+// pop looks into the inner queue first, so a chain of follow-ups cannot starve it.
+template <class Inner = FifoQueuePolicy>
+class RunNextQueuePolicy {
+public:
+    static constexpr auto kMaxSlotAge = std::chrono::microseconds(20);
+    static constexpr size_t kFairnessInterval = 61;
+
+    void Attach(const void* executor, size_t num_workers) {
+        if constexpr (requires { inner_.Attach(executor, num_workers); }) {
+            inner_.Attach(executor, num_workers);
+        }
+        executor_ = executor;
+        slots_ = std::vector<CacheLinePadded<Slot>>(num_workers);
+    }
+
+    bool Push(std::shared_ptr<Task> task) {
+        if (detail::current_worker.executor != executor_ || closed_.load()) {
+            return inner_.Push(std::move(task));
+        }
+        auto& slot = slots_[detail::current_worker.index].value;
+        std::shared_ptr<Task> displaced;
+        {
+            std::lock_guard guard(slot.mutex);
+            displaced = std::exchange(slot.task, std::move(task));
+            slot.since = std::chrono::steady_clock::now();
+        }
+        if (displaced && !inner_.Push(displaced)) {
+            // Closed meanwhile: the new task is the one turned away.
+            std::lock_guard guard(slot.mutex);
+            slot.task = std::move(displaced);
+            return false;
+        }
+        return true;
+    }
+
+    void Requeue(std::shared_ptr<Task> task) {
+        if constexpr (requires { inner_.Requeue(task); }) {
+            inner_.Requeue(std::move(task));
+        } else {
+            inner_.Push(std::move(task));
+        }
+    }
+
+    std::shared_ptr<Task> TryPop() {
+        if (detail::current_worker.executor != executor_) {
+            return inner_.TryPop();
+        }
+        size_t self = detail::current_worker.index;
+        auto& slot = slots_[self].value;
+        bool inner_first = ++slot.pops % kFairnessInterval == 0;
+        if (inner_first) {
+            if (auto task = inner_.TryPop()) {
+                return task;
+            }
+        }
+        if (auto task = TakeSlot(slot, std::chrono::steady_clock::duration::zero())) {
+            return task;
+        }
+        if (!inner_first) {
+            if (auto task = inner_.TryPop()) {
+                return task;
+            }
+        }
+        return Steal(self);
+    }
+
+    void Close() {
+        closed_.store(true);
+        inner_.Close();
+    }
+
+    bool IsClosed() {
+        return inner_.IsClosed();
+    }
+
+private:
+    struct Slot {
+        std::mutex mutex;
+        std::shared_ptr<Task> task;
+        std::chrono::steady_clock::time_point since;
+        // Touched by the owner only.
+        size_t pops = 0;
+    };
+
+    static std::shared_ptr<Task> TakeSlot(Slot& slot, std::chrono::steady_clock::duration min_age) {
+        std::lock_guard guard(slot.mutex);
+        if (!slot.task || std::chrono::steady_clock::now() - slot.since < min_age) {
+            return nullptr;
+        }
+        return std::move(slot.task);
+    }
+
+    // Takes an aged task from another slot. If the only ones there are young, waits for the oldest
+    // of them to age: its owner is likely to run it any moment, otherwise it gets stolen.
+    std::shared_ptr<Task> Steal(size_t self) {
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        for (size_t i = 1; i < slots_.size(); ++i) {
+            auto& slot = slots_[(self + i) % slots_.size()].value;
+            std::unique_lock guard(slot.mutex, std::try_to_lock);
+            if (guard && slot.task) {
+                deadline = std::min(deadline, slot.since + kMaxSlotAge);
+            }
+        }
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            return nullptr;
+        }
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        for (size_t i = 1; i < slots_.size(); ++i) {
+            if (auto task = TakeSlot(slots_[(self + i) % slots_.size()].value, kMaxSlotAge)) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    Inner inner_;
+    const void* executor_ = nullptr;
+    std::atomic<bool> closed_ = false;
+    std::vector<CacheLinePadded<Slot>> slots_;
+};
+
+// Wraps another queue with a queue per worker for the tasks meant for that worker: tasks with an
+// affinity hint, and dependents that a task finishing on the worker made ready, so that they read
+// its result from the local cache. A worker serves its own queue before the inner one, starting
+// with the newest dependent it made ready itself, and takes from the queues of other workers only
+// when it has nothing else to do.
+template <class Inner = FifoQueuePolicy>
+class LocalQueuePolicy {
+public:
+    void Attach(const void* executor, size_t num_workers) {
+        if constexpr (requires { inner_.Attach(executor, num_workers); }) {
+            inner_.Attach(executor, num_workers);
+        }
+        executor_ = executor;
+        locals_ = std::vector<CacheLinePadded<Local>>(num_workers);
+    }
+
+    bool Push(std::shared_ptr<Task> task) {
+        return inner_.Push(std::move(task));
+    }
+
+    size_t PushTo(size_t worker, std::shared_ptr<Task> task) {
+        auto& local = locals_[worker].value;
+        std::lock_guard guard(local.mutex);
+        if (local.closed) {
+            return 0;
+        }
+        if (IsCurrentWorker(worker)) {
+            local.tasks.push_front(std::move(task));
+        } else {
+            local.tasks.push_back(std::move(task));
+        }
+        local.size.store(local.tasks.size(), std::memory_order_relaxed);
+        return local.tasks.size();
+    }
+
+    void Requeue(std::shared_ptr<Task> task) {
+        if constexpr (requires { inner_.Requeue(task); }) {
+            inner_.Requeue(std::move(task));
+        } else {
+            inner_.Push(std::move(task));
+        }
+    }
+
+    std::shared_ptr<Task> TryPop() {
+        if (detail::current_worker.executor != executor_) {
+            return inner_.TryPop();
+        }
+        size_t self = detail::current_worker.index;
+        if (auto task = TryPopLocal(locals_[self].value)) {
+            return task;
+        }
+        if (auto task = inner_.TryPop()) {
+            return task;
+        }
+        for (size_t i = 1; i < locals_.size(); ++i) {
+            if (auto task = TryPopLocal(locals_[(self + i) % locals_.size()].value)) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void Close() {
+        for (auto& local : locals_) {
+            std::lock_guard guard(local.value.mutex);
+            local.value.closed = true;
+        }
+        inner_.Close();
+    }
+
+    bool IsClosed() {
+        return inner_.IsClosed();
+    }
+
+private:
+    struct Local {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Task>> tasks;
+        std::atomic<size_t> size = 0;
+        bool closed = false;
+    };
+
+    bool IsCurrentWorker(size_t worker) const {
+        return detail::current_worker.executor == executor_ &&
+               detail::current_worker.index == worker;
+    }
+
+    static std::shared_ptr<Task> TryPopLocal(Local& local) {
+        if (local.size.load(std::memory_order_relaxed) == 0) {
+            return nullptr;
+        }
+        std::lock_guard guard(local.mutex);
+        if (local.tasks.empty()) {
+            return nullptr;
+        }
+        auto task = std::move(local.tasks.front());
+        local.tasks.pop_front();
+        local.size.store(local.tasks.size(), std::memory_order_relaxed);
+        return task;
+    }
+
+    Inner inner_;
+    const void* executor_ = nullptr;
+    std::vector<CacheLinePadded<Local>> locals_;
+};
+
+// Placements pick the worker queue for a task submitted by a thread that is not a worker, given a
+// hint of the length of every queue:
+//     size_t Pick(const std::vector<CacheLinePadded<std::atomic<size_t>>>& lengths);
+
+namespace detail {
+
+// xorshift64*, one generator per thread.
+inline uint64_t NextRandom() {
+    thread_local uint64_t state =
+        0x9E3779B97F4A7C15ull ^ reinterpret_cast<uintptr_t>(&state) ^
+        static_cast<uint64_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+}
+
+}  // namespace detail
+
+class RandomPlacement {
+public:
+    size_t Pick(const std::vector<CacheLinePadded<std::atomic<size_t>>>& lengths) {
+        return detail::NextRandom() % lengths.size();
+    }
+};
+
+class RoundRobinPlacement {
+public:
+    size_t Pick(const std::vector<CacheLinePadded<std::atomic<size_t>>>& lengths) {
+        return next_.fetch_add(1, std::memory_order_relaxed) % lengths.size();
+    }
+
+private:
+    std::atomic<size_t> next_ = 0;
+};
+
+// Samples two queues and takes the shorter one, which keeps the longest queue within a few tasks
+// of the average for about the cost of random placement.
+class TwoChoicesPlacement {
+public:
+    size_t Pick(const std::vector<CacheLinePadded<std::atomic<size_t>>>& lengths) {
+        uint64_t random = detail::NextRandom();
+        size_t first = (random & 0xFFFFFFFF) % lengths.size();
+        size_t second = (random >> 32) % lengths.size();
+        return lengths[second].value.load(std::memory_order_relaxed) <
+                       lengths[first].value.load(std::memory_order_relaxed)
+                   ? second
+                   : first;
+    }
+};
+
+// A queue per worker instead of a shared one. Workers push to their own queue and pop from it, and
+// steal from the others once it is empty. Submissions from other threads are spread by Placement.
+// Queue lengths are kept as hints in padded atomics, which placements and thieves read without
+// taking any lock.
+template <class Placement = TwoChoicesPlacement>
+class DistributedQueuePolicy {
+public:
+    void Attach(const void* executor, size_t num_workers) {
+        executor_ = executor;
+        queues_ = std::vector<CacheLinePadded<Queue>>(num_workers);
+        lengths_ = std::vector<CacheLinePadded<std::atomic<size_t>>>(num_workers);
+    }
+
+    bool Push(std::shared_ptr<Task> task) {
+        size_t worker = detail::current_worker.executor == executor_
+                            ? detail::current_worker.index
+                            : placement_.Pick(lengths_);
+        return PushTo(worker, std::move(task)) != 0;
+    }
+
+    size_t PushTo(size_t worker, std::shared_ptr<Task> task) {
+        auto& queue = queues_[worker].value;
+        std::lock_guard guard(queue.mutex);
+        if (queue.closed) {
+            return 0;
+        }
+        queue.tasks.push_back(std::move(task));
+        lengths_[worker].value.store(queue.tasks.size(), std::memory_order_relaxed);
+        return queue.tasks.size();
+    }
+
+    std::shared_ptr<Task> TryPop() {
+        size_t self = detail::current_worker.executor == executor_ ? detail::current_worker.index
+                                                                   : 0;
+        for (size_t i = 0; i < queues_.size(); ++i) {
+            size_t worker = (self + i) % queues_.size();
+            if (lengths_[worker].value.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            auto& queue = queues_[worker].value;
+            std::lock_guard guard(queue.mutex);
+            if (!queue.tasks.empty()) {
+                auto task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                lengths_[worker].value.store(queue.tasks.size(), std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void Close() {
+        for (auto& queue : queues_) {
+            std::lock_guard guard(queue.value.mutex);
+            queue.value.closed = true;
+        }
+        closed_.store(true);
+    }
+
+    bool IsClosed() {
+        return closed_.load();
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Task>> tasks;
+        bool closed = false;
+    };
+
+    const void* executor_ = nullptr;
+    [[no_unique_address]] Placement placement_;
+    std::vector<CacheLinePadded<Queue>> queues_;
+    std::vector<CacheLinePadded<std::atomic<size_t>>> lengths_;
+    std::atomic<bool> closed_ = false;
+};
+
+// Idle workers sleep on an epoch counter through atomic wait, every notification bumps it.
+class BlockingWaitPolicy {
+public:
+    uint64_t PrepareWait() {
+        return epoch_.load();
+    }
+
+    void Wait(uint64_t key) {
+        epoch_.wait(key);
+    }
+
+    void NotifyOne() {
+        epoch_.fetch_add(1);
+        epoch_.notify_one();
+    }
+
+    void NotifyAll() {
+        epoch_.fetch_add(1);
+        epoch_.notify_all();
+    }
+
+private:
+    std::atomic<uint64_t> epoch_ = 0;
+};
+
+// Idle workers keep polling the queue and only yield in between: the lowest wake-up latency, paid
+// for with a busy core per idle worker. Submitters never have to notify anyone.
+class SpinWaitPolicy {
+public:
+    uint64_t PrepareWait() {
+        return 0;
+    }
+
+    void Wait(uint64_t) {
+        std::this_thread::yield();
+    }
+
+    void NotifyOne() {
+    }
+
+    void NotifyAll() {
+    }
+};
+
+class DefaultAllocPolicy {
+public:
+    template <class T, class... Args>
+    std::shared_ptr<T> Make(Args&&... args) {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+};
+
+class NoStatsPolicy {
+public:
+    void OnSubmit() {
+    }
+
+    void OnRun() {
+    }
+
+    void OnRequeue() {
+    }
+
+    void OnFailure() {
+    }
+};
+
+// Relaxed counters, each on its own cache line since every worker bumps them.
+class CountingStatsPolicy {
+public:
+    struct Counters {
+        uint64_t submitted = 0;
+        uint64_t run = 0;
+        uint64_t requeued = 0;
+        uint64_t failed = 0;
+    };
+
+    void OnSubmit() {
+        submitted_.value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnRun() {
+        run_.value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnRequeue() {
+        requeued_.value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnFailure() {
+        failed_.value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Counters Get() const {
+        return {submitted_.value.load(std::memory_order_relaxed),
+                run_.value.load(std::memory_order_relaxed),
+                requeued_.value.load(std::memory_order_relaxed),
+                failed_.value.load(std::memory_order_relaxed)};
+    }
+
+private:
+    CacheLinePadded<std::atomic<uint64_t>> submitted_;
+    CacheLinePadded<std::atomic<uint64_t>> run_;
+    CacheLinePadded<std::atomic<uint64_t>> requeued_;
+    CacheLinePadded<std::atomic<uint64_t>> failed_;
+};
+
+// Runs tasks right on the worker thread.
+class DirectRunPolicy {
+public:
+    template <class E, class F>
+    void Run(E&, std::shared_ptr<Task> task, F execute) {
+        execute(*task);
+    }
+};
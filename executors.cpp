@@ -1,231 +1,257 @@
 #include <executors.h>
 
+#include <mutex>
+#include <optional>
+
+struct Task::Extras {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Task>> dependencies;
+    std::vector<std::shared_ptr<Task>> triggers;
+    std::optional<SysClock::time_point> deadline;
+    std::exception_ptr e_ptr;
+    std::vector<std::function<void()>> finish_callbacks;
+};
+
+Task::~Task() {
+    delete extras_.load();
+}
+
+Task::Extras& Task::GetExtras() {
+    Extras* extras = extras_.load();
+    if (!extras) {
+        auto fresh = std::make_unique<Extras>();
+        if (extras_.compare_exchange_strong(extras, fresh.get())) {
+            extras = fresh.release();
+        }
+    }
+    return *extras;
+}
+
 void Task::AddDependency(std::shared_ptr<Task> dep) {
-    std::unique_lock lock(mutex_);
-    dependencies_.push_back(std::move(dep));
+    auto& extras = GetExtras();
+    std::unique_lock lock(extras.mutex);
+    extras.dependencies.push_back(std::move(dep));
 }
 
 void Task::AddTrigger(std::shared_ptr<Task> dep) {
-    std::unique_lock lock(mutex_);
-    triggers_.push_back(std::move(dep));
+    auto& extras = GetExtras();
+    std::unique_lock lock(extras.mutex);
+    extras.triggers.push_back(std::move(dep));
 }
 
 void Task::SetTimeTrigger(std::chrono::system_clock::time_point at) {
-    std::unique_lock lock(mutex_);
-    deadline_ = at;
+    auto& extras = GetExtras();
+    std::unique_lock lock(extras.mutex);
+    extras.deadline = at;
 }
 
+// Finished dependencies and, once one of them fired, all triggers are dropped right away, so that
+// a pending task does not keep its predecessors (and their results) alive.
 bool Task::CanBeExecuted() {
-    std::unique_lock lock(mutex_);
+    Extras* extras = extras_.load();
+    if (!extras) {
+        return true;
+    }
+    std::unique_lock lock(extras->mutex);
 
-    for (auto& dependency : dependencies_) {
-        if (dependency && !dependency->IsFinished()) {
-            return false;
-        }
+    std::erase_if(extras->dependencies, [](auto& dep) { return !dep || dep->IsFinished(); });
+    if (!extras->dependencies.empty()) {
+        return false;
     }
 
-    if (std::chrono::system_clock::now() < deadline_) {
+    if (extras->deadline && std::chrono::system_clock::now() < *extras->deadline) {
         return false;
     }
 
-    for (auto& trigger : triggers_) {
+    for (auto& trigger : extras->triggers) {
         if (trigger && trigger->IsFinished()) {
+            extras->triggers.clear();
             return true;
         }
     }
-    return triggers_.empty();
+    return extras->triggers.empty();
+}
+
+std::optional<Task::SysClock::time_point> Task::PendingTimeTrigger() {
+    Extras* extras = extras_.load();
+    if (!extras) {
+        return std::nullopt;
+    }
+    std::unique_lock lock(extras->mutex);
+    if (extras->deadline && SysClock::now() < *extras->deadline) {
+        return extras->deadline;
+    }
+    return std::nullopt;
 }
 
 bool Task::IsCompleted() {
-    std::unique_lock lock(mutex_);
-    return status_ == TaskStatus::kCompleted;
+    return status_.load() == TaskStatus::kCompleted;
 }
 
 bool Task::IsFailed() {
-    std::unique_lock lock(mutex_);
-    return status_ == TaskStatus::kFailed;
+    return status_.load() == TaskStatus::kFailed;
 }
 
 bool Task::IsCanceled() {
-    std::unique_lock lock(mutex_);
-    return status_ == TaskStatus::kCanceled;
+    return status_.load() == TaskStatus::kCanceled;
 }
 
 bool Task::IsFinished() {
-    std::unique_lock lock(mutex_);
-    return status_ != TaskStatus::kPending;
+    return status_.load() > TaskStatus::kRunning;
 }
 
 std::exception_ptr Task::GetError() {
-    std::unique_lock lock(mutex_);
-    return e_ptr_;
+    Extras* extras = extras_.load();
+    if (!extras) {
+        return nullptr;
+    }
+    std::unique_lock lock(extras->mutex);
+    return extras->e_ptr;
 }
 
 void Task::Cancel() {
-    std::unique_lock lock(mutex_);
-    if (status_ == TaskStatus::kPending) {
-        status_ = TaskStatus::kCanceled;
-        wait_.notify_all();
-    }
+    Finish(TaskStatus::kCanceled, nullptr);
 }
 
-void Task::Wait() {
-    std::unique_lock lock(mutex_);
-    while (status_ == TaskStatus::kPending) {
-        wait_.wait(lock);
+void Task::OnFinish(std::function<void()> callback) {
+    auto& extras = GetExtras();
+    std::unique_lock lock(extras.mutex);
+    if (!IsFinished()) {
+        extras.finish_callbacks.push_back(std::move(callback));
+        return;
     }
+    lock.unlock();
+    callback();
 }
 
-void Task::SaveError(std::exception_ptr e_ptr) {
-    std::unique_lock lock(mutex_);
-    e_ptr_ = e_ptr;
-    status_ = TaskStatus::kFailed;
-    wait_.notify_all();
+void Task::SetAffinity(size_t worker) {
+    affinity_ = worker < kNoAffinity ? static_cast<uint32_t>(worker) : kNoAffinity;
 }
 
-void Task::CompleteTask() {
-    std::unique_lock lock(mutex_);
-    status_ = TaskStatus::kCompleted;
-    wait_.notify_all();
+size_t Task::Affinity() const {
+    return affinity_ == kNoAffinity ? kNoWorker : affinity_;
 }
 
-std::shared_ptr<Executor> MakeThreadPoolExecutor(int num_threads) {
-    return std::make_shared<Executor>(num_threads);
+void Task::SetPriority(int priority) {
+    priority_ = static_cast<int8_t>(std::clamp(priority, kMinPriority, kMaxPriority));
+    effective_priority_.store(priority_);
 }
 
-Executor::~Executor() {
-    task_queue_.Close();
-    for (auto& t : workers_) {
-        if (t.joinable()) {
-            t.join();
-        }
-    }
+int Task::Priority() const {
+    return effective_priority_.load();
 }
 
-Executor::Executor(int num_threads) {
-    workers_.reserve(num_threads);
-    while (num_threads-- > 0) {
-        workers_.emplace_back([this] { RunTask(); });
-    }
+bool Task::RaisePriority(int priority) {
+    int8_t current = effective_priority_.load();
+    do {
+        if (current >= priority) {
+            return false;
+        }
+    } while (!effective_priority_.compare_exchange_weak(current, static_cast<int8_t>(priority)));
+    return true;
 }
 
-void Executor::Submit(std::shared_ptr<Task> task) {
-    if (task_queue_.IsClosed()) {
-        task->Cancel();
-        return;
+std::vector<std::shared_ptr<Task>> Task::UnfinishedDependencies() {
+    Extras* extras = extras_.load();
+    if (!extras) {
+        return {};
     }
-    if (!task->IsCanceled()) {
-        task_queue_.Put(std::move(task));
+    std::unique_lock lock(extras->mutex);
+    std::vector<std::shared_ptr<Task>> pending;
+    for (auto& dep : extras->dependencies) {
+        if (dep && !dep->IsFinished()) {
+            pending.push_back(dep);
+        }
     }
+    return pending;
 }
 
-void Executor::StartShutdown() {
-    task_queue_.Close();
-}
-
-void Executor::WaitShutdown() {
-    for (auto& t : workers_) {
-        if (t.joinable()) {
-            t.join();
+std::shared_ptr<Task> Task::UnfinishedDependency() {
+    Extras* extras = extras_.load();
+    if (!extras) {
+        return nullptr;
+    }
+    std::unique_lock lock(extras->mutex);
+    for (auto& dep : extras->dependencies) {
+        if (dep && !dep->IsFinished()) {
+            return dep;
         }
     }
+    return nullptr;
 }
 
-void Executor::RunTask() {
-    while (auto task = task_queue_.Take()) {
-        if (!task || !task->CanBeExecuted()) {
-            task_queue_.Put(task);
-            continue;
-        }
-        if (task->IsCanceled()) {
-            continue;
-        }
-        try {
-            task->Run();
-            task->CompleteTask();
-        } catch (...) {
-            std::exception_ptr e_ptr = std::current_exception();
-            task->SaveError(e_ptr);
-        }
+void Task::Wait() {
+    if (!IsFinished() && detail::fiber_wait_hook.suspend) {
+        auto hook = detail::fiber_wait_hook;
+        hook.suspend(hook.fiber, *this);
+    }
+    auto status = status_.load();
+    while (status <= TaskStatus::kRunning) {
+        status_.wait(status);
+        status = status_.load();
     }
 }
 
-template <class T>
-FuturePtr<T> Executor::Invoke(std::function<T()> fn) {
-    auto task = std::make_shared<Future<T>>(fn);
-    Submit(task);
-    return task;
+void Task::SaveError(std::exception_ptr e_ptr) {
+    Finish(TaskStatus::kFailed, std::move(e_ptr));
 }
-template <class Y, class T>
-FuturePtr<Y> Executor::Then(FuturePtr<T> input, std::function<Y()> fn) {
-    auto task = std::make_shared<Future<Y>>(fn);
-    std::dynamic_pointer_cast<Task>(task)->AddDependency(input);
-    Submit(task);
-    return task;
+
+void Task::CompleteTask() {
+    Finish(TaskStatus::kCompleted, nullptr);
 }
-template <class T>
-FuturePtr<std::vector<T>> Executor::WhenAll(std::vector<FuturePtr<T>> all) {
-    auto funk = [all] {
-        std::vector<T> resulting_vector;
-        resulting_vector.reserve(all.size());
-        for (FuturePtr<T> task : all) {
-            resulting_vector.emplace_back(task->Get());
-        }
-        return resulting_vector;
-    };
-    return Invoke<std::vector<T>>(funk);
-}
-
-template <class T>
-FuturePtr<T> Executor::WhenFirst(std::vector<FuturePtr<T>> all) {
-    auto funk = [all] {
-        for (FuturePtr<T> task : all) {
-            if (task->IsFinished()) {
-                return task->Get();
-            }
-        }
-    };
-    auto task = std::make_shared<Future<T>>(funk);
 
-    for (FuturePtr<T> elem : all) {
-        task->AddTrigger(elem);
-    }
-    Submit(task);
-    return task;
+bool Task::TryStart() {
+    auto expected = TaskStatus::kPending;
+    return status_.compare_exchange_strong(expected, TaskStatus::kRunning);
 }
 
-template <class T>
-FuturePtr<std::vector<T>> Executor::WhenAllBeforeDeadline(
-    std::vector<FuturePtr<T>> all, std::chrono::system_clock::time_point deadline) {
+// The side record is locked, if there is one, around the status change: OnFinish registers under
+// the same lock after checking the status, so a callback is either taken here or run by OnFinish.
+// A record created concurrently is picked up by loading the pointer again after the change.
+bool Task::Finish(TaskStatus status, std::exception_ptr e_ptr) {
+    Extras* extras = e_ptr ? &GetExtras() : extras_.load();
+    std::unique_lock<std::mutex> lock;
+    if (extras) {
+        lock = std::unique_lock(extras->mutex);
+    }
 
-    auto funk = [all] {
-        std::vector<T> finished_tasks_vector;
-        finished_tasks_vector.reserve(all.size());
-        for (FuturePtr<T> task : all) {
-            if (task->IsFinished()) {
-                finished_tasks_vector.emplace_back(task->Get());
-            }
+    auto current = status_.load();
+    do {
+        if (current > TaskStatus::kRunning ||
+            (current == TaskStatus::kRunning && status == TaskStatus::kCanceled)) {
+            return false;
         }
-        return finished_tasks_vector;
-    };
+    } while (!status_.compare_exchange_weak(current, status));
 
-    auto task = std::make_shared<Future<std::vector<T>>>(funk);
-    task->SetTimeTrigger(deadline);
+    if (!extras && (extras = extras_.load())) {
+        lock = std::unique_lock(extras->mutex);
+    }
+    std::vector<std::function<void()>> callbacks;
+    if (extras) {
+        extras->e_ptr = std::move(e_ptr);
+        extras->dependencies.clear();
+        extras->triggers.clear();
+        callbacks = std::move(extras->finish_callbacks);
+        lock.unlock();
+    }
 
-    Submit(task);
-    return task;
+    status_.notify_all();
+    for (auto& callback : callbacks) {
+        callback();
+    }
+    return true;
 }
 
-template <class T>
-T Future<T>::Get() {
-    Wait();
-    if (IsFailed()) {
-        rethrow_exception(GetError());
+bool PriorityQueuePolicy::Push(std::shared_ptr<Task> task) {
+    size_t level = task->Priority() - Task::kMinPriority;
+    std::lock_guard guard(mutex_);
+    if (closed_) {
+        return false;
     }
-    return value_;
+    levels_[level].push_back(std::move(task));
+    occupied_[level / 64] |= uint64_t{1} << level % 64;
+    return true;
 }
 
-template <class T>
-void Future<T>::Run() {
-    value_ = fn_();
-}
\ No newline at end of file
+template class BasicExecutor<FifoQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy,
+                             NoStatsPolicy>;
@@ -1,23 +1,44 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
-#include <deque>
+#include <cmath>
+#include <cstdint>
+#include <current_worker.h>
+#include <executor_policies.h>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <reclamation.h>
+#include <shared_mutex>
+#include <stop_token>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <timer.h>
+#include <tuple>
+#include <unordered_map>
 #include <unbounded_blocking_queue.h>
 #include <vector>
 
-class Executor;
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy = DirectRunPolicy>
+class BasicExecutor;
 
+// The task itself only holds its status word and a pointer to a side record with everything most
+// tasks never use: dependencies, triggers, the time trigger, the error and finish callbacks. The
+// record is allocated by the first call that needs it.
 class Task : public std::enable_shared_from_this<Task> {
 public:
     using SysClock = std::chrono::system_clock;
 
-    virtual ~Task() = default;
+    Task() = default;
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    virtual ~Task();
 
     virtual void Run() = 0;
 
@@ -43,52 +64,182 @@ public:
 
     std::exception_ptr GetError();
 
+    // Has no effect once the task has started running.
     void Cancel();
 
+    // Blocks the calling thread until the task is finished. Called from a task of an executor with
+    // FiberRunPolicy, only the fiber of that task is suspended and the worker runs other tasks.
     void Wait();
 
-private:
-    friend Executor;
+    // Calls `callback` once the task is finished, on the thread that finished it, or right away
+    // if it already is. Callbacks must not throw.
+    void OnFinish(std::function<void()> callback);
+
+    // Worker that should preferably run the task, kNoWorker by default. Only a hint: queue policies
+    // without queues per worker ignore it, and idle workers may still take the task.
+    void SetAffinity(size_t worker);
+
+    size_t Affinity() const;
+
+    // Tasks with a higher priority run first, 0 by default, clamped to kMinPriority..kMaxPriority.
+    // Only queue policies that order tasks by priority look at it, such as PriorityQueuePolicy.
+    // Set it before submitting the task.
+    void SetPriority(int priority);
+
+    // Effective priority: the task's own, or higher while a pending task with a higher priority
+    // depends on it. Drops back to the task's own priority once it starts running.
+    int Priority() const;
+
+    static constexpr int kMinPriority = INT8_MIN;
+    static constexpr int kMaxPriority = INT8_MAX;
+
+protected:
+    template <class, class, class, class, class>
+    friend class BasicExecutor;
+    friend class ShardedExecutor;
+
+    using RunFunction = void (*)(Task*);
+
+    // Tasks built with a run function are run through it instead of the virtual Run.
+    explicit Task(RunFunction run_function) : run_function_(run_function) {
+    }
 
     void SaveError(std::exception_ptr e_ptr);
 
     void CompleteTask();
 
 private:
-    enum class TaskStatus { kPending, kCompleted, kFailed, kCanceled };
+    enum class TaskStatus : uint8_t { kPending, kRunning, kCompleted, kFailed, kCanceled };
+
+    struct Extras;
+
+    Extras& GetExtras();
+
+    // Claims a pending task for running, fails if it was canceled.
+    bool TryStart();
+
+    bool Finish(TaskStatus status, std::exception_ptr e_ptr);
+
+    // A dependency that has not finished yet, null if there is none.
+    std::shared_ptr<Task> UnfinishedDependency();
+
+    // Dependencies that have not finished yet.
+    std::vector<std::shared_ptr<Task>> UnfinishedDependencies();
+
+    // The time trigger, if it has not passed yet.
+    std::optional<SysClock::time_point> PendingTimeTrigger();
+
+    // Raises the effective priority to `priority`, returns false if it already was at least that.
+    bool RaisePriority(int priority);
+
+private:
+    static constexpr uint32_t kNoAffinity = UINT32_MAX;
+
+    std::atomic<TaskStatus> status_ = TaskStatus::kPending;
+    // These fit into the padding after the status.
+    int8_t priority_ = 0;
+    std::atomic<int8_t> effective_priority_ = 0;
+    // Set while the task sits in a queue that supports priority inheritance.
+    std::atomic<bool> queued_ = false;
+    uint32_t affinity_ = kNoAffinity;
+    RunFunction run_function_ = nullptr;
+    std::atomic<Extras*> extras_ = nullptr;
+};
 
-    std::mutex mutex_;
-    std::condition_variable wait_;
+// Task with the callable stored inline, run by the executor through a plain function pointer
+// instead of a virtual call and a std::function. It is an ordinary Task otherwise: it can have
+// dependencies, be waited for and canceled. Create it with MakeFunctionTask.
+template <class F>
+class FunctionTask final : public Task {
+public:
+    explicit FunctionTask(F fn) : Task(&RunStatic), fn_(std::move(fn)) {
+    }
 
-    std::exception_ptr e_ptr_;
-    TaskStatus status_ = TaskStatus::kPending;
+    void Run() override {
+        fn_();
+    }
 
-    std::deque<std::shared_ptr<Task>> dependencies_;
-    std::deque<std::shared_ptr<Task>> triggers_;
+private:
+    static void RunStatic(Task* task) {
+        static_cast<FunctionTask*>(task)->fn_();
+    }
 
-    SysClock::time_point deadline_ = std::chrono::system_clock::now();
+    F fn_;
 };
 
+template <class F>
+std::shared_ptr<FunctionTask<std::decay_t<F>>> MakeFunctionTask(F&& fn) {
+    return std::make_shared<FunctionTask<std::decay_t<F>>>(std::forward<F>(fn));
+}
+
 template <class T>
 class Future;
 
 template <class T>
 using FuturePtr = std::shared_ptr<Future<T>>;
 
+// Finished futures in completion order, closed after the last one.
+template <class T>
+using FutureStream = std::shared_ptr<UnboundedBlockingQueue<Future<T>>>;
+
 struct Unit {};
 
-class Executor {
+enum class WhenAllMode {
+    // Waits for every input, then rethrows the first error in input order.
+    kWaitAll,
+    // Fails on the first error and cancels the inputs that have not started yet.
+    kFailFast,
+    // Waits for every input, then fails with an AggregateError holding all errors in input order.
+    kCollectErrors,
+};
+
+class AggregateError : public std::runtime_error {
+public:
+    explicit AggregateError(std::vector<std::exception_ptr> errors)
+        : std::runtime_error("WhenAll: " + std::to_string(errors.size()) + " inputs failed"),
+          errors_(std::move(errors)) {
+    }
+
+    const std::vector<std::exception_ptr>& Errors() const {
+        return errors_;
+    }
+
+private:
+    std::vector<std::exception_ptr> errors_;
+};
+
+// Thread pool composed of the policies described in executor_policies.h.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+class BasicExecutor {
 public:
-    ~Executor();
+    ~BasicExecutor();
+
+    BasicExecutor(int num_threads);
 
-    Executor(int num_threads);
+    // Returns false if the task was not queued because it is canceled or the executor is shut down.
+    bool Submit(std::shared_ptr<Task> task);
 
-    void Submit(std::shared_ptr<Task> task);
+    // Submits a graph of tasks linked by AddDependency, `costs[i]` being an estimate of how long
+    // `tasks[i]` runs in any unit, 1 for all if empty. With a queue policy that orders by priority,
+    // every task gets the length of the costliest path from it to the end of the graph as its
+    // priority, scaled to 0..kMaxPriority, so ready tasks on the critical path run first. Returns
+    // false if some task was not queued. None of the tasks may have been submitted before. Throws
+    // std::invalid_argument, without submitting anything, if `costs` is not empty and does not
+    // hold one non-negative cost per task.
+    bool SubmitGraph(const std::vector<std::shared_ptr<Task>>& tasks,
+                     const std::vector<double>& costs = {});
 
     void StartShutdown();
 
     void WaitShutdown();
 
+    size_t NumThreads() const;
+
+    StatsPolicy& Stats() {
+        return stats_;
+    }
+
     template <class T>
     FuturePtr<T> Invoke(std::function<T()> fn);
 
@@ -96,24 +247,100 @@ public:
     FuturePtr<Y> Then(FuturePtr<T> input, std::function<Y()> fn);
 
     template <class T>
-    FuturePtr<std::vector<T>> WhenAll(std::vector<FuturePtr<T>> all);
+    FuturePtr<std::vector<T>> WhenAll(std::vector<FuturePtr<T>> all,
+                                      WhenAllMode mode = WhenAllMode::kWaitAll);
+
+    template <class T, class... Ts>
+    FuturePtr<std::tuple<T, Ts...>> WhenAll(FuturePtr<T> first, FuturePtr<Ts>... rest);
 
     template <class T>
     FuturePtr<T> WhenFirst(std::vector<FuturePtr<T>> all);
 
+    template <class T>
+    FutureStream<T> WhenEach(std::vector<FuturePtr<T>> all);
+
+    template <class T>
+    FuturePtr<std::vector<T>> WhenN(std::vector<FuturePtr<T>> all, size_t k,
+                                    bool cancel_rest = false);
+
+    template <class T>
+    FuturePtr<std::vector<T>> WhenMajority(std::vector<FuturePtr<T>> all,
+                                           bool cancel_rest = false);
+
+    template <class T>
+    FuturePtr<T> Hedge(std::function<T(std::stop_token)> fn,
+                       std::chrono::system_clock::duration delay, size_t max_copies);
+
     template <class T>
     FuturePtr<std::vector<T>> WhenAllBeforeDeadline(std::vector<FuturePtr<T>> all,
                                                     std::chrono::system_clock::time_point deadline);
 
 private:
-    void RunTask();
+    void RunTask(size_t index);
+
+    void Execute(Task& task);
+
+    // `queue_length` gets how many tasks the queue of `worker` holds after the push, if the task
+    // went into one.
+    bool Enqueue(const std::shared_ptr<Task>& task, size_t worker, size_t* queue_length = nullptr);
+
+    void Park(std::shared_ptr<Task> task, Task& dependency);
+
+    void Delay(std::shared_ptr<Task> task, Task::SysClock::time_point at);
+
+    Timer& GetTimer();
+
+    bool Unpark(const std::shared_ptr<Task>& task);
+
+    void InheritPriority(Task& task);
+
+    // Queue policies with Reprioritize order tasks by priority, which dependencies inherit.
+    static constexpr bool kInheritsPriority =
+        requires(QueuePolicy& queue, std::shared_ptr<Task> task) { queue.Reprioritize(task); };
+
+    // Lets parked tasks outlive the executor: once it is gone, they are canceled instead.
+    struct Parking {
+        BasicExecutor* executor;
+        std::shared_mutex mutex;
+    };
 
 private:
-    UnboundedBlockingQueue<Task> task_queue_;
+    QueuePolicy task_queue_;
+    WaitPolicy wait_;
+    [[no_unique_address]] AllocPolicy alloc_;
+    [[no_unique_address]] StatsPolicy stats_;
+    [[no_unique_address]] RunPolicy run_;
+    std::shared_ptr<Parking> parking_ = std::make_shared<Parking>(this);
     std::vector<std::jthread> workers_;
+    // Started by the first Hedge or time trigger, so that executors which use neither do without
+    // the thread.
+    std::once_flag timer_started_;
+    std::unique_ptr<Timer> timer_;
+};
+
+using Executor =
+    BasicExecutor<FifoQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy, NoStatsPolicy>;
+
+using LowLatencyExecutor =
+    BasicExecutor<FifoQueuePolicy, SpinWaitPolicy, DefaultAllocPolicy, NoStatsPolicy>;
+
+template <class E = Executor>
+std::shared_ptr<E> MakeThreadPoolExecutor(int num_threads) {
+    return std::make_shared<E>(num_threads);
+}
+
+namespace detail {
+
+// Set while a fiber of FiberRunPolicy runs on the thread: Task::Wait then suspends the fiber
+// instead of blocking the thread.
+struct FiberWaitHook {
+    void (*suspend)(void* fiber, Task& task) = nullptr;
+    void* fiber = nullptr;
 };
 
-std::shared_ptr<Executor> MakeThreadPoolExecutor(int num_threads);
+inline thread_local FiberWaitHook fiber_wait_hook;
+
+}  // namespace detail
 
 template <class T>
 class Future : public Task {
@@ -121,6 +348,10 @@ public:
     Future(std::function<T()> fn) : fn_(std::move(fn)) {
     }
 
+    // Future without a body. It is never submitted and gets completed from the outside through
+    // SetValue or SetError, exactly once.
+    Future() = default;
+
     ~Future() override = default;
 
     Future(const Future&) = default;
@@ -133,7 +364,735 @@ public:
 
     void Run() override;
 
+    void SetValue(T value);
+
+    void SetError(std::exception_ptr e_ptr);
+
 private:
     T value_;
     std::function<T()> fn_;
 };
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::~BasicExecutor() {
+    StartShutdown();
+    WaitShutdown();
+    // Pending timer callbacks run right away and find the queue closed.
+    timer_.reset();
+    std::lock_guard guard(parking_->mutex);
+    parking_->executor = nullptr;
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::BasicExecutor(
+    int num_threads) {
+    if constexpr (requires { task_queue_.Attach(this, size_t{}); }) {
+        task_queue_.Attach(this, num_threads);
+    }
+    workers_.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+        workers_.emplace_back([this, i] { RunTask(i); });
+    }
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+bool BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::Submit(
+    std::shared_ptr<Task> task) {
+    if (task->IsCanceled()) {
+        return false;
+    }
+    if constexpr (kInheritsPriority) {
+        InheritPriority(*task);
+    }
+    if (!Enqueue(task, task->Affinity())) {
+        task->Cancel();
+        return false;
+    }
+    stats_.OnSubmit();
+    wait_.NotifyOne();
+    return true;
+}
+
+// Upward ranks are computed from the exits of the graph backwards, in reverse topological order.
+// Dependencies on tasks outside the graph are ignored; tasks on a cycle keep their priority.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+bool BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::SubmitGraph(
+    const std::vector<std::shared_ptr<Task>>& tasks, const std::vector<double>& costs) {
+    if (!costs.empty() && costs.size() != tasks.size()) {
+        throw std::invalid_argument("SubmitGraph: costs and tasks differ in size");
+    }
+    // Negative costs would let ranks grow along edges, and NaN fails this too.
+    if (!std::all_of(costs.begin(), costs.end(), [](double cost) { return cost >= 0; })) {
+        throw std::invalid_argument("SubmitGraph: costs must be non-negative");
+    }
+    if constexpr (kInheritsPriority) {
+        std::unordered_map<Task*, size_t> indices;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            indices.emplace(tasks[i].get(), i);
+        }
+        std::vector<std::vector<size_t>> dependencies(tasks.size());
+        std::vector<size_t> unranked_successors(tasks.size());
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            for (auto& dep : tasks[i]->UnfinishedDependencies()) {
+                if (auto it = indices.find(dep.get()); it != indices.end()) {
+                    dependencies[i].push_back(it->second);
+                    ++unranked_successors[it->second];
+                }
+            }
+        }
+
+        std::vector<double> ranks(tasks.size());
+        std::vector<size_t> ready;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            if (unranked_successors[i] == 0) {
+                ready.push_back(i);
+            }
+        }
+        double max_rank = 0;
+        while (!ready.empty()) {
+            size_t i = ready.back();
+            ready.pop_back();
+            ranks[i] += costs.empty() ? 1 : costs[i];
+            max_rank = std::max(max_rank, ranks[i]);
+            for (size_t dep : dependencies[i]) {
+                ranks[dep] = std::max(ranks[dep], ranks[i]);
+                if (--unranked_successors[dep] == 0) {
+                    ready.push_back(dep);
+                }
+            }
+        }
+        double scale = max_rank > 0 ? Task::kMaxPriority / max_rank : 0;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            if (unranked_successors[i] == 0) {
+                tasks[i]->SetPriority(std::lround(ranks[i] * scale));
+            }
+        }
+    }
+
+    bool queued = true;
+    for (auto& task : tasks) {
+        queued = Submit(task) && queued;
+    }
+    return queued;
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+bool BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::Enqueue(
+    const std::shared_ptr<Task>& task, size_t worker, size_t* queue_length) {
+    if constexpr (kInheritsPriority) {
+        task->queued_.store(true);
+    }
+    if constexpr (requires { task_queue_.PushTo(worker, task); }) {
+        if (worker != kNoWorker) {
+            size_t length = task_queue_.PushTo(worker % workers_.size(), task);
+            if (queue_length) {
+                *queue_length = length;
+            }
+            return length != 0;
+        }
+    }
+    return task_queue_.Push(task);
+}
+
+// A task waiting for a dependency is not requeued over and over: it is parked on the dependency
+// and queued again by whoever finishes it, on that worker's own queue if the queue policy has one.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+void BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::Park(
+    std::shared_ptr<Task> task, Task& dependency) {
+    dependency.OnFinish([parking = parking_, task = std::move(task)] {
+        bool queued = false;
+        {
+            std::shared_lock guard(parking->mutex);
+            queued = parking->executor && parking->executor->Unpark(task);
+        }
+        if (!queued) {
+            task->Cancel();
+        }
+    });
+}
+
+// A task with a time trigger in the future is handed to the timer, which queues it again once the
+// time comes, instead of being requeued until then.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+void BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::Delay(
+    std::shared_ptr<Task> task, Task::SysClock::time_point at) {
+    auto when = Timer::Clock::now() +
+                std::chrono::duration_cast<Timer::Clock::duration>(at - Task::SysClock::now());
+    GetTimer().At(when, [parking = parking_, task = std::move(task)] {
+        bool queued = false;
+        {
+            std::shared_lock guard(parking->mutex);
+            queued = parking->executor && parking->executor->Unpark(task);
+        }
+        if (!queued) {
+            task->Cancel();
+        }
+    });
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+Timer& BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::GetTimer() {
+    std::call_once(timer_started_, [this] { timer_ = std::make_unique<Timer>(); });
+    return *timer_;
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+bool BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::Unpark(
+    const std::shared_ptr<Task>& task) {
+    size_t worker = task->Affinity();
+    bool on_worker = detail::current_worker.executor == this;
+    if (worker == kNoWorker && on_worker) {
+        worker = detail::current_worker.index;
+    }
+    size_t queue_length = 0;
+    if (!Enqueue(task, worker, &queue_length)) {
+        return false;
+    }
+    // A task alone in the queue of the calling worker itself runs once the current one is done;
+    // waking up another worker would only invite it to steal the task. The dependents of a task
+    // with many of them all land there too, and the others are woken up to share them.
+    bool alone_in_own_queue = on_worker && queue_length == 1 &&
+                              worker % workers_.size() == detail::current_worker.index;
+    if (!alone_in_own_queue) {
+        wait_.NotifyOne();
+    }
+    return true;
+}
+
+// Raises the priority of every pending task `task` transitively depends on to its own. A task
+// waiting in the queue is queued once more under the new priority; the entry under the old one is
+// skipped when popped, and whichever entry is popped first claims the task. The walk stops at tasks
+// whose priority already is high enough, their own dependencies were raised when they got it.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+void BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::InheritPriority(
+    Task& task) {
+    int priority = task.Priority();
+    auto pending = task.UnfinishedDependencies();
+    while (!pending.empty()) {
+        auto dep = std::move(pending.back());
+        pending.pop_back();
+        if (dep->status_.load() != Task::TaskStatus::kPending || !dep->RaisePriority(priority)) {
+            continue;
+        }
+        if constexpr (kInheritsPriority) {
+            if (dep->queued_.load()) {
+                task_queue_.Reprioritize(dep);
+            }
+        }
+        for (auto& next : dep->UnfinishedDependencies()) {
+            pending.push_back(std::move(next));
+        }
+    }
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+void BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::StartShutdown() {
+    task_queue_.Close();
+    wait_.NotifyAll();
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+void BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::WaitShutdown() {
+    for (auto& t : workers_) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+size_t
+BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::NumThreads() const {
+    return workers_.size();
+}
+
+// Tasks waiting only for triggers go back to the end of the queue. Once the queue is closed,
+// workers finish what is left in it and exit.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+void BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::RunTask(
+    size_t index) {
+    detail::current_worker = {this, index};
+    auto& epoch = EpochDomain::Global().ThisThread();
+    epoch.Online();
+    while (true) {
+        // Nothing from the previous task is referenced anymore.
+        epoch.Quiescent();
+        auto task = task_queue_.TryPop();
+        if (!task) {
+            auto key = wait_.PrepareWait();
+            task = task_queue_.TryPop();
+            if (!task) {
+                epoch.Offline();
+                if (task_queue_.IsClosed()) {
+                    return;
+                }
+                wait_.Wait(key);
+                epoch.Online();
+                continue;
+            }
+        }
+
+        if constexpr (kInheritsPriority) {
+            // Another entry of the same task was popped first.
+            if (!task->queued_.exchange(false)) {
+                continue;
+            }
+        }
+        if (task->IsCanceled()) {
+            continue;
+        }
+        if (!task->CanBeExecuted()) {
+            stats_.OnRequeue();
+            if (auto dependency = task->UnfinishedDependency()) {
+                Park(std::move(task), *dependency);
+            } else if (auto at = task->PendingTimeTrigger()) {
+                Delay(std::move(task), *at);
+            } else if constexpr (requires { task_queue_.Requeue(task); }) {
+                task_queue_.Requeue(std::move(task));
+            } else {
+                if constexpr (kInheritsPriority) {
+                    task->queued_.store(true);
+                }
+                task_queue_.Push(std::move(task));
+            }
+            continue;
+        }
+        if (!task->TryStart()) {
+            continue;
+        }
+        if constexpr (kInheritsPriority) {
+            task->effective_priority_.store(task->priority_);
+        }
+        stats_.OnRun();
+        run_.Run(*this, std::move(task), [this](Task& task) { Execute(task); });
+    }
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+void BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::Execute(
+    Task& task) {
+    try {
+        if (task.run_function_) {
+            task.run_function_(&task);
+        } else {
+            task.Run();
+        }
+        task.CompleteTask();
+    } catch (...) {
+        stats_.OnFailure();
+        task.SaveError(std::current_exception());
+    }
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class T>
+FuturePtr<T> BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::Invoke(
+    std::function<T()> fn) {
+    auto task = alloc_.template Make<Future<T>>(fn);
+    Submit(task);
+    return task;
+}
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class Y, class T>
+FuturePtr<Y> BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::Then(
+    FuturePtr<T> input, std::function<Y()> fn) {
+    auto task = alloc_.template Make<Future<Y>>(fn);
+    std::dynamic_pointer_cast<Task>(task)->AddDependency(input);
+    Submit(task);
+    return task;
+}
+// Driven by finish callbacks of the inputs, so no worker waits on them. The last callback to
+// arrive assembles the result unless a fail-fast error has already been delivered.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class T>
+FuturePtr<std::vector<T>>
+BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::WhenAll(
+    std::vector<FuturePtr<T>> all, WhenAllMode mode) {
+    auto result = alloc_.template Make<Future<std::vector<T>>>();
+    if (all.empty()) {
+        result->SetValue({});
+        return result;
+    }
+
+    struct State {
+        std::vector<FuturePtr<T>> all;
+        FuturePtr<std::vector<T>> result;
+        WhenAllMode mode;
+        std::atomic<size_t> remaining;
+        std::atomic<bool> failed{false};
+    };
+    auto state = std::make_shared<State>();
+    state->all = all;
+    state->result = result;
+    state->mode = mode;
+    state->remaining = all.size();
+
+    auto complete = [](State& state) {
+        std::vector<T> values;
+        std::vector<std::exception_ptr> errors;
+        values.reserve(state.all.size());
+        for (auto& task : state.all) {
+            if (task->IsFailed()) {
+                errors.push_back(task->GetError());
+            } else if (errors.empty()) {
+                values.push_back(task->Get());
+            }
+        }
+        if (errors.empty()) {
+            state.result->SetValue(std::move(values));
+        } else if (state.mode == WhenAllMode::kCollectErrors) {
+            state.result->SetError(std::make_exception_ptr(AggregateError(std::move(errors))));
+        } else {
+            state.result->SetError(errors.front());
+        }
+    };
+
+    for (FuturePtr<T>& task : all) {
+        task->OnFinish([state, complete, task = task.get()] {
+            if (state->mode == WhenAllMode::kFailFast && task->IsFailed() &&
+                !state->failed.exchange(true)) {
+                state->result->SetError(task->GetError());
+                for (auto& sibling : state->all) {
+                    sibling->Cancel();
+                }
+            }
+            if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+                !state->failed.load()) {
+                complete(*state);
+            }
+        });
+    }
+    return result;
+}
+
+// Heterogeneous WhenAll: the state is a fixed tuple plus one counter, the callbacks of every input
+// are instantiated per index at compile time. Fails with the first error to arrive, a canceled
+// input counts as failed. The other inputs may have further consumers, so they are left running.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class T, class... Ts>
+FuturePtr<std::tuple<T, Ts...>>
+BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::WhenAll(
+    FuturePtr<T> first, FuturePtr<Ts>... rest) {
+    using Tuple = std::tuple<T, Ts...>;
+    struct State {
+        Tuple values;
+        FuturePtr<Tuple> result;
+        std::atomic<size_t> remaining{1 + sizeof...(Ts)};
+        std::atomic<bool> failed{false};
+    };
+    auto state = std::make_shared<State>();
+    state->result = alloc_.template Make<Future<Tuple>>();
+    auto result = state->result;
+
+    auto subscribe = [&state](auto index, auto& input) {
+        input->OnFinish([state, input = input.get()] {
+            if (input->IsFailed() || input->IsCanceled()) {
+                if (!state->failed.exchange(true)) {
+                    auto error = input->IsFailed() ? input->GetError()
+                                                   : std::make_exception_ptr(std::runtime_error(
+                                                         "WhenAll: input canceled"));
+                    state->result->SetError(error);
+                }
+            } else {
+                std::get<decltype(index)::value>(state->values) = input->Get();
+            }
+            if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+                !state->failed.load()) {
+                state->result->SetValue(std::move(state->values));
+            }
+        });
+    };
+    [&]<size_t... Is>(std::index_sequence<Is...>, auto&... inputs) {
+        (subscribe(std::integral_constant<size_t, Is>{}, inputs), ...);
+    }(std::index_sequence_for<T, Ts...>{}, first, rest...);
+    return result;
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class T>
+FuturePtr<T> BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::WhenFirst(
+    std::vector<FuturePtr<T>> all) {
+    auto funk = [all] {
+        for (FuturePtr<T> task : all) {
+            if (task->IsFinished()) {
+                return task->Get();
+            }
+        }
+    };
+    auto task = alloc_.template Make<Future<T>>(funk);
+
+    for (FuturePtr<T> elem : all) {
+        task->AddTrigger(elem);
+    }
+    Submit(task);
+    return task;
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class T>
+FutureStream<T>
+BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::WhenEach(
+    std::vector<FuturePtr<T>> all) {
+    auto stream = std::make_shared<UnboundedBlockingQueue<Future<T>>>();
+    if (all.empty()) {
+        stream->Close();
+        return stream;
+    }
+
+    auto remaining = std::make_shared<std::atomic<size_t>>(all.size());
+    for (FuturePtr<T> task : all) {
+        task->OnFinish([stream, remaining, task] {
+            stream->Put(task);
+            if (remaining->fetch_sub(1) == 1) {
+                stream->Close();
+            }
+        });
+    }
+    return stream;
+}
+
+// Completes with k values as soon as k inputs have completed, or fails with the error that made it
+// impossible. Successes and failures are packed into one atomic word, so exactly one callback sees
+// the transition that decides the result. With cancel_rest the inputs that have not started yet are
+// canceled once the result is known.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class T>
+FuturePtr<std::vector<T>>
+BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::WhenN(
+    std::vector<FuturePtr<T>> all, size_t k, bool cancel_rest) {
+    if (k > all.size()) {
+        throw std::invalid_argument("WhenN: k is larger than the number of inputs");
+    }
+    auto result = alloc_.template Make<Future<std::vector<T>>>();
+    if (k == 0) {
+        result->SetValue({});
+        return result;
+    }
+
+    struct State {
+        std::vector<FuturePtr<T>> all;
+        FuturePtr<std::vector<T>> result;
+        size_t k;
+        size_t max_failures;
+        bool cancel_rest;
+        std::atomic<uint64_t> counts{0};
+    };
+    constexpr uint64_t kSuccess = 1;
+    constexpr uint64_t kFailure = uint64_t{1} << 32;
+
+    auto state = std::make_shared<State>();
+    state->all = all;
+    state->result = result;
+    state->k = k;
+    state->max_failures = all.size() - k;
+    state->cancel_rest = cancel_rest;
+
+    auto finish = [](State& state) {
+        if (state.cancel_rest) {
+            for (auto& task : state.all) {
+                task->Cancel();
+            }
+        }
+        state.all.clear();
+    };
+
+    for (FuturePtr<T>& task : all) {
+        task->OnFinish([state, finish, task = task.get()] {
+            if (task->IsCompleted()) {
+                uint64_t prev = state->counts.fetch_add(kSuccess, std::memory_order_acq_rel);
+                if ((prev & (kFailure - 1)) + 1 != state->k || (prev >> 32) > state->max_failures) {
+                    return;
+                }
+                // Every counted success is already completed, any k of them will do.
+                std::vector<T> values;
+                values.reserve(state->k);
+                for (auto& input : state->all) {
+                    if (values.size() < state->k && input->IsCompleted()) {
+                        values.push_back(input->Get());
+                    }
+                }
+                state->result->SetValue(std::move(values));
+            } else {
+                uint64_t prev = state->counts.fetch_add(kFailure, std::memory_order_acq_rel);
+                if ((prev >> 32) != state->max_failures || (prev & (kFailure - 1)) >= state->k) {
+                    return;
+                }
+                auto error = task->GetError();
+                if (!error) {
+                    error = std::make_exception_ptr(std::runtime_error("WhenN: input canceled"));
+                }
+                state->result->SetError(error);
+            }
+            finish(*state);
+        });
+    }
+    return result;
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class T>
+FuturePtr<std::vector<T>>
+BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::WhenMajority(
+    std::vector<FuturePtr<T>> all, bool cancel_rest) {
+    size_t k = all.size() / 2 + 1;
+    return WhenN(std::move(all), k, cancel_rest);
+}
+
+// Runs fn and, if it has not finished after `delay`, another copy of it, up to max_copies copies
+// launched by the timer. A copy that fails launches the next one right away instead. The first copy
+// to complete wins: the copies that have not started are canceled and the running ones are asked to
+// stop through the token. Fails only if every copy fails, with the error of the first one.
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class T>
+FuturePtr<T> BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::Hedge(
+    std::function<T(std::stop_token)> fn, std::chrono::system_clock::duration delay,
+    size_t max_copies) {
+    struct State {
+        std::vector<FuturePtr<T>> copies;
+        FuturePtr<T> result;
+        std::stop_source stop;
+        std::atomic<size_t> remaining;
+        // Copies are launched in order, [0, launched) already are.
+        std::atomic<size_t> launched{0};
+        std::atomic<bool> done{false};
+    };
+    max_copies = std::max<size_t>(max_copies, 1);
+    auto state = std::make_shared<State>();
+    state->result = alloc_.template Make<Future<T>>();
+    state->remaining = max_copies;
+
+    auto launch_next = [this](State& state) {
+        size_t index = state.launched.fetch_add(1, std::memory_order_acq_rel);
+        if (index < state.copies.size()) {
+            Submit(state.copies[index]);
+        }
+    };
+    for (size_t i = 0; i < max_copies; ++i) {
+        auto copy = alloc_.template Make<Future<T>>([fn, token = state->stop.get_token()] {
+            return fn(token);
+        });
+        copy->OnFinish([state, copy = copy.get(), launch_next] {
+            if (copy->IsCompleted() && !state->done.exchange(true)) {
+                state->result->SetValue(copy->Get());
+                state->stop.request_stop();
+                for (auto& other : state->copies) {
+                    other->Cancel();
+                }
+            } else if (!copy->IsCompleted() && !state->done.load()) {
+                launch_next(*state);
+            }
+            if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+                !state->done.exchange(true)) {
+                std::exception_ptr error;
+                for (auto& other : state->copies) {
+                    if (!error && other->IsFailed()) {
+                        error = other->GetError();
+                    }
+                }
+                if (!error) {
+                    error = std::make_exception_ptr(std::runtime_error("Hedge: copies canceled"));
+                }
+                state->result->SetError(error);
+            }
+        });
+        state->copies.push_back(std::move(copy));
+    }
+
+    // Callbacks read `copies`, so nothing may launch before the vector is complete. A backup the
+    // timer fires for may already have been launched by a failure, then it is left alone.
+    auto start = Timer::Clock::now();
+    auto step = std::chrono::duration_cast<Timer::Clock::duration>(delay);
+    launch_next(*state);
+    for (size_t i = 1; i < max_copies; ++i) {
+        GetTimer().At(start + step * i, [this, state, i] {
+            size_t expected = i;
+            if (!state->done.load() &&
+                state->launched.compare_exchange_strong(expected, i + 1,
+                                                        std::memory_order_acq_rel)) {
+                Submit(state->copies[i]);
+            }
+        });
+    }
+    return state->result;
+}
+
+template <class QueuePolicy, class WaitPolicy, class AllocPolicy, class StatsPolicy,
+          class RunPolicy>
+template <class T>
+FuturePtr<std::vector<T>>
+BasicExecutor<QueuePolicy, WaitPolicy, AllocPolicy, StatsPolicy, RunPolicy>::WhenAllBeforeDeadline(
+    std::vector<FuturePtr<T>> all, std::chrono::system_clock::time_point deadline) {
+
+    auto funk = [all] {
+        std::vector<T> finished_tasks_vector;
+        finished_tasks_vector.reserve(all.size());
+        for (FuturePtr<T> task : all) {
+            if (task->IsFinished()) {
+                finished_tasks_vector.emplace_back(task->Get());
+            }
+        }
+        return finished_tasks_vector;
+    };
+
+    auto task = alloc_.template Make<Future<std::vector<T>>>(funk);
+    task->SetTimeTrigger(deadline);
+
+    Submit(task);
+    return task;
+}
+
+template <class T>
+T Future<T>::Get() {
+    Wait();
+    if (IsFailed()) {
+        rethrow_exception(GetError());
+    }
+    return value_;
+}
+
+template <class T>
+void Future<T>::Run() {
+    // Whatever the body captured, typically the futures it read from, is not needed anymore once
+    // it returns or throws.
+    auto fn = std::move(fn_);
+    fn_ = nullptr;
+    value_ = fn();
+}
+
+template <class T>
+void Future<T>::SetValue(T value) {
+    value_ = std::move(value);
+    CompleteTask();
+}
+
+template <class T>
+void Future<T>::SetError(std::exception_ptr e_ptr) {
+    SaveError(e_ptr);
+}
+
+extern template class BasicExecutor<FifoQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy,
+                                    NoStatsPolicy>;
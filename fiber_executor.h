@@ -0,0 +1,224 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <executors.h>
+
+// Runs every task on its own fiber. When a task calls Wait on a task that is not finished yet, its
+// fiber is suspended and the worker goes on with other tasks; once the awaited task finishes, the
+// fiber is queued again and resumed by whichever worker picks it up. Many more tasks than workers
+// can thus block at the same time without tying up threads.
+//
+// Fibers switch with ucontext and run on mmap'ed stacks of kStackSize bytes, below which a
+// PROT_NONE guard page turns an overflow into a crash instead of silent corruption. Every guarded
+// stack takes two memory mappings, so the number of fibers alive at once is bounded by half of
+// vm.max_map_count; unguarded stacks allow twice as many. Finished fibers are kept for reuse, up
+// to kMaxCachedFibers.
+//
+// Like a worker blocked in Wait on a plain executor, a suspended task holds up the destruction of
+// the executor until it has finished: after the workers exit, tasks resume right on the thread that
+// finishes what they wait for.
+//
+// A suspended task may resume on another worker: it must not hold thread-bound state across Wait,
+// such as a locked mutex, thread_local references or an exception being handled. The worker
+// announces a quiescent state while the task is suspended, so neither can it hold pointers read
+// from structures that use EpochDomain.
+template <size_t kStackSize = 64 << 10, bool kGuardPage = true>
+class BasicFiberRunPolicy {
+public:
+    static constexpr size_t kMaxCachedFibers = 1024;
+
+    BasicFiberRunPolicy() = default;
+    BasicFiberRunPolicy(const BasicFiberRunPolicy&) = delete;
+    BasicFiberRunPolicy& operator=(const BasicFiberRunPolicy&) = delete;
+
+    ~BasicFiberRunPolicy() {
+        std::unique_lock lock(mutex_);
+        closing_ = true;
+        released_.wait(lock, [this] { return live_ == 0; });
+        for (Fiber* fiber : free_) {
+            delete fiber;
+        }
+    }
+
+    template <class E, class F>
+    void Run(E& executor, std::shared_ptr<Task> task, F execute) {
+        if (typeid(*task) == typeid(ResumeTask)) {
+            // Picks up a suspended fiber, right on the worker stack.
+            execute(*task);
+            return;
+        }
+        Fiber* fiber;
+        try {
+            fiber = Acquire();
+        } catch (const std::bad_alloc&) {
+            // Out of stacks or mappings: the task blocks its worker like on a plain executor.
+            execute(*task);
+            return;
+        }
+        fiber->task = std::move(task);
+        fiber->execute = std::move(execute);
+        fiber->submit = [&executor](std::shared_ptr<Task> resume) {
+            return executor.Submit(std::move(resume));
+        };
+        getcontext(&fiber->context);
+        fiber->context.uc_stack.ss_sp = fiber->stack;
+        fiber->context.uc_stack.ss_size = kStackSize;
+        fiber->context.uc_link = nullptr;
+        auto address = reinterpret_cast<uintptr_t>(fiber);
+        makecontext(&fiber->context, reinterpret_cast<void (*)()>(&Entry), 2,
+                    static_cast<uint32_t>(address >> 32), static_cast<uint32_t>(address));
+        SwitchIn(fiber);
+    }
+
+private:
+    struct Fiber {
+        Fiber() {
+            size_t guard = kGuardPage ? sysconf(_SC_PAGESIZE) : 0;
+            mapping_size = kStackSize + guard;
+            void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (mapping == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            if (guard && mprotect(mapping, guard, PROT_NONE) != 0) {
+                munmap(mapping, mapping_size);
+                throw std::bad_alloc();
+            }
+            stack = static_cast<char*>(mapping) + guard;
+        }
+
+        Fiber(const Fiber&) = delete;
+        Fiber& operator=(const Fiber&) = delete;
+
+        ~Fiber() {
+            munmap(stack - (mapping_size - kStackSize), mapping_size);
+        }
+
+        ucontext_t context;
+        // Context the fiber switches back to when it suspends or finishes.
+        ucontext_t* resumer = nullptr;
+        char* stack;
+        size_t mapping_size;
+        std::shared_ptr<Task> task;
+        std::function<void(Task&)> execute;
+        std::function<bool(std::shared_ptr<Task>)> submit;
+        Task* waiting_for = nullptr;
+        bool finished = false;
+    };
+
+    class ResumeTask : public Task {
+    public:
+        ResumeTask(BasicFiberRunPolicy* policy, Fiber* fiber) : policy_(policy), fiber_(fiber) {
+        }
+
+        void Run() override {
+            policy_->SwitchIn(fiber_);
+        }
+
+    private:
+        BasicFiberRunPolicy* policy_;
+        Fiber* fiber_;
+    };
+
+    static void Entry(uint32_t high, uint32_t low) {
+        auto* fiber = reinterpret_cast<Fiber*>(static_cast<uintptr_t>(high) << 32 | low);
+        fiber->execute(*fiber->task);
+        fiber->task.reset();
+        fiber->finished = true;
+        swapcontext(&fiber->context, fiber->resumer);
+    }
+
+    static void Suspend(void* opaque, Task& task) {
+        auto* fiber = static_cast<Fiber*>(opaque);
+        fiber->waiting_for = &task;
+        swapcontext(&fiber->context, fiber->resumer);
+    }
+
+    // Runs `fiber` until it finishes or suspends. A suspended fiber is resumed through a task
+    // submitted once the awaited task finishes, or inline if the executor no longer takes tasks or
+    // is being destroyed.
+    void SwitchIn(Fiber* fiber) {
+        ucontext_t resumer;
+        fiber->resumer = &resumer;
+        auto hook = std::exchange(detail::fiber_wait_hook, {&Suspend, fiber});
+        swapcontext(&resumer, &fiber->context);
+        detail::fiber_wait_hook = hook;
+
+        if (fiber->finished) {
+            Release(fiber);
+            return;
+        }
+        // The fiber is fully switched out, so it is safe to resume it from now on. The awaited
+        // task is alive: the suspended Wait call is one of its methods.
+        std::exchange(fiber->waiting_for, nullptr)->OnFinish([this, fiber] {
+            if (!Resubmit(fiber)) {
+                SwitchIn(fiber);
+            }
+        });
+    }
+
+    // The lock keeps the destructor from going past closing_ while the executor is called.
+    bool Resubmit(Fiber* fiber) {
+        std::lock_guard guard(mutex_);
+        return !closing_ && fiber->submit(std::make_shared<ResumeTask>(this, fiber));
+    }
+
+    Fiber* Acquire() {
+        {
+            std::lock_guard guard(mutex_);
+            if (!free_.empty()) {
+                Fiber* fiber = free_.back();
+                free_.pop_back();
+                ++live_;
+                return fiber;
+            }
+        }
+        auto* fiber = new Fiber();
+        std::lock_guard guard(mutex_);
+        ++live_;
+        return fiber;
+    }
+
+    void Release(Fiber* fiber) {
+        fiber->execute = nullptr;
+        fiber->submit = nullptr;
+        fiber->finished = false;
+        {
+            std::lock_guard guard(mutex_);
+            if (free_.size() < kMaxCachedFibers) {
+                free_.push_back(fiber);
+                fiber = nullptr;
+            }
+        }
+        delete fiber;
+        // Last, so that the destructor waits until the fiber is cached or deleted.
+        std::lock_guard guard(mutex_);
+        --live_;
+        released_.notify_all();
+    }
+
+    std::mutex mutex_;
+    std::condition_variable released_;
+    std::vector<Fiber*> free_;
+    // Fibers running or suspended.
+    size_t live_ = 0;
+    bool closing_ = false;
+};
+
+using FiberRunPolicy = BasicFiberRunPolicy<>;
+
+using FiberExecutor = BasicExecutor<FifoQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy,
+                                    NoStatsPolicy, FiberRunPolicy>;
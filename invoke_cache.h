@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <cache_line.h>
+#include <executors.h>
+#include <sharding.h>
+
+// Memoizes Executor::Invoke by key. A hit returns the future that computed the value, already
+// completed or still in flight, without going through the executor queue, so concurrent misses on
+// a key collapse into one computation as in SingleFlight. Failed computations are not cached.
+//
+// Entries live at most `ttl` after the computation was started. Every shard holds a fixed ring of
+// capacity / num_shards slots and evicts with CLOCK: a hit sets the reference bit of its slot, the
+// hand clears set bits and replaces the first slot it finds clear.
+//
+// Must outlive the computations it started.
+template <class Key, class T, class Hash = std::hash<Key>>
+class InvokeCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+
+    InvokeCache(std::shared_ptr<Executor> executor, size_t capacity, Clock::duration ttl,
+                size_t num_shards = 16)
+        : executor_(std::move(executor)), ttl_(ttl), shards_(num_shards) {
+        size_t slots = std::max<size_t>(1, (capacity + num_shards - 1) / num_shards);
+        for (auto& shard : shards_) {
+            shard.value.slots.resize(slots);
+        }
+    }
+
+    FuturePtr<T> Invoke(const Key& key, std::function<T()> fn) {
+        auto& shard = ShardFor(key);
+        auto now = Clock::now();
+        std::unique_lock lock(shard.mutex);
+
+        if (auto it = shard.index.find(key); it != shard.index.end()) {
+            Slot& slot = shard.slots[it->second];
+            if (now < slot.expires) {
+                slot.referenced = true;
+                ++shard.stats.hits;
+                return slot.value;
+            }
+            Evict(shard, it->second);
+        }
+        ++shard.stats.misses;
+
+        auto value = std::make_shared<Future<T>>(std::move(fn));
+        size_t position = NextVictim(shard);
+        Evict(shard, position);
+        shard.slots[position] = Slot{key, value, now + ttl_, false};
+        shard.index.emplace(key, position);
+        lock.unlock();
+
+        value->OnFinish([&shard, key, value = value.get()] {
+            if (value->IsCompleted()) {
+                return;
+            }
+            std::unique_lock lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end() && shard.slots[it->second].value.get() == value) {
+                Evict(shard, it->second);
+            }
+        });
+        executor_->Submit(value);
+        return value;
+    }
+
+    size_t Size() {
+        size_t size = 0;
+        for (auto& shard : shards_) {
+            std::unique_lock lock(shard.value.mutex);
+            size += shard.value.index.size();
+        }
+        return size;
+    }
+
+    Stats GetStats() {
+        Stats total;
+        for (auto& shard : shards_) {
+            std::unique_lock lock(shard.value.mutex);
+            total.hits += shard.value.stats.hits;
+            total.misses += shard.value.stats.misses;
+        }
+        return total;
+    }
+
+private:
+    struct Slot {
+        Key key{};
+        FuturePtr<T> value;
+        Clock::time_point expires;
+        bool referenced = false;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, size_t, Hash> index;
+        std::vector<Slot> slots;
+        size_t hand = 0;
+        Stats stats;
+    };
+
+    Shard& ShardFor(const Key& key) {
+        return shards_[ShardIndex(Hash{}(key), shards_.size())].value;
+    }
+
+    static size_t NextVictim(Shard& shard) {
+        while (true) {
+            size_t position = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.slots.size();
+            Slot& slot = shard.slots[position];
+            if (!slot.value || !slot.referenced) {
+                return position;
+            }
+            slot.referenced = false;
+        }
+    }
+
+    static void Evict(Shard& shard, size_t position) {
+        Slot& slot = shard.slots[position];
+        if (slot.value) {
+            shard.index.erase(slot.key);
+            slot = Slot{};
+        }
+    }
+
+    std::shared_ptr<Executor> executor_;
+    Clock::duration ttl_;
+    std::vector<CacheLinePadded<Shard>> shards_;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+#include <reclamation.h>
+
+// Treiber stack. Popped nodes are retired to an EpochDomain, which also rules out ABA: a node
+// cannot be freed and reused while a concurrent Pop still looks at it.
+template <class T>
+class LockFreeStack {
+public:
+    explicit LockFreeStack(EpochDomain& domain = EpochDomain::Global()) : domain_(domain) {
+    }
+
+    LockFreeStack(const LockFreeStack&) = delete;
+    LockFreeStack& operator=(const LockFreeStack&) = delete;
+
+    ~LockFreeStack() {
+        for (Node* node = head_.load(); node;) {
+            delete std::exchange(node, node->next);
+        }
+    }
+
+    void Push(T value) {
+        auto* node = new Node{std::move(value), head_.load(std::memory_order_relaxed)};
+        while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+        }
+    }
+
+    std::optional<T> Pop() {
+        HazardPointer hazard(domain_);
+        while (true) {
+            Node* head = hazard.Protect(head_);
+            if (!head) {
+                return std::nullopt;
+            }
+            if (head_.compare_exchange_weak(head, head->next, std::memory_order_acquire,
+                                            std::memory_order_relaxed)) {
+                std::optional<T> value(std::move(head->value));
+                hazard.Reset();
+                domain_.Retire(head);
+                return value;
+            }
+        }
+    }
+
+private:
+    struct Node {
+        T value;
+        Node* next;
+    };
+
+    EpochDomain& domain_;
+    std::atomic<Node*> head_ = nullptr;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <executors.h>
+
+// Splits [begin, end) into chunks of `grain` indices and calls body(chunk_begin, chunk_end) for
+// each of them on the executor. The calling thread runs the first chunk itself and then blocks
+// until the rest is done, so it should not be a worker of the same executor.
+template <class F>
+void ParallelFor(Executor& executor, size_t begin, size_t end, size_t grain, F body) {
+    if (begin >= end) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+
+    std::vector<std::shared_ptr<Task>> chunks;
+    chunks.reserve((end - begin - 1) / grain);
+    for (size_t lo = begin + std::min(grain, end - begin); lo < end; lo += grain) {
+        size_t hi = lo + std::min(grain, end - lo);
+        auto chunk = MakeFunctionTask([&body, lo, hi] { body(lo, hi); });
+        executor.Submit(chunk);
+        chunks.push_back(std::move(chunk));
+    }
+
+    std::exception_ptr inline_error;
+    try {
+        body(begin, begin + std::min(grain, end - begin));
+    } catch (...) {
+        inline_error = std::current_exception();
+    }
+
+    // Every chunk references `body`, so all of them have to finish before anything is rethrown.
+    for (auto& chunk : chunks) {
+        chunk->Wait();
+    }
+    if (inline_error) {
+        std::rethrow_exception(inline_error);
+    }
+    for (auto& chunk : chunks) {
+        if (chunk->IsCanceled()) {
+            throw std::runtime_error("ParallelFor: executor is shut down");
+        }
+        if (chunk->IsFailed()) {
+            std::rethrow_exception(chunk->GetError());
+        }
+    }
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+#include <cache_line.h>
+#include <executors.h>
+#include <parallel_for.h>
+
+namespace detail {
+
+// Inputs shorter than this are scanned on the calling thread.
+inline constexpr size_t kParallelScanThreshold = 1 << 16;
+
+// Splits n elements into blocks, at least a few per worker so that a slow worker does not stall the
+// second pass.
+inline size_t ScanBlockCount(const Executor& executor, size_t n) {
+    size_t blocks = std::min(executor.NumThreads() * 4, n / (kParallelScanThreshold / 4));
+    return std::max<size_t>(1, blocks);
+}
+
+// The inner loops below are written over plain indices with a local accumulator and no early
+// exits, so that the compiler is free to vectorize them for arithmetic types.
+template <class It, class T, class BinaryOp>
+T ReduceBlock(It first, size_t begin, size_t end, T acc, BinaryOp op) {
+    for (size_t i = begin; i < end; ++i) {
+        acc = op(acc, first[i]);
+    }
+    return acc;
+}
+
+template <class It, class Predicate>
+size_t CountBlock(It first, size_t begin, size_t end, Predicate pred) {
+    size_t count = 0;
+    for (size_t i = begin; i < end; ++i) {
+        count += pred(first[i]) ? 1 : 0;
+    }
+    return count;
+}
+
+}  // namespace detail
+
+// Two pass blocked scans: the first pass reduces every block into a cache-line padded partial, the
+// partials are scanned serially and the second pass rescans every block starting from its carry.
+// `op` must be associative. Output may alias input. Blocks the calling thread, see ParallelFor.
+template <class InputIt, class OutputIt, class BinaryOp>
+OutputIt ParallelInclusiveScan(Executor& executor, InputIt first, InputIt last, OutputIt out,
+                               BinaryOp op) {
+    using T = typename std::iterator_traits<InputIt>::value_type;
+
+    const size_t n = last - first;
+    if (n < detail::kParallelScanThreshold || executor.NumThreads() < 2) {
+        return std::inclusive_scan(first, last, out, op);
+    }
+
+    const size_t num_blocks = detail::ScanBlockCount(executor, n);
+    const size_t block_size = (n + num_blocks - 1) / num_blocks;
+    std::vector<CacheLinePadded<T>> carry(num_blocks);
+
+    // Block 0 never needs its total, so the first pass skips the last block instead.
+    ParallelFor(executor, 0, num_blocks - 1, 1, [&](size_t lo, size_t hi) {
+        for (size_t block = lo; block < hi; ++block) {
+            size_t begin = block * block_size;
+            size_t end = std::min(n, begin + block_size);
+            carry[block + 1].value =
+                detail::ReduceBlock(first, begin + 1, end, T(first[begin]), op);
+        }
+    });
+    for (size_t block = 2; block < num_blocks; ++block) {
+        carry[block].value = op(carry[block - 1].value, carry[block].value);
+    }
+
+    ParallelFor(executor, 0, num_blocks, 1, [&](size_t lo, size_t hi) {
+        for (size_t block = lo; block < hi; ++block) {
+            size_t begin = block * block_size;
+            size_t end = std::min(n, begin + block_size);
+            if (begin >= end) {
+                continue;
+            }
+            T acc = block == 0 ? T(first[begin]) : op(carry[block].value, first[begin]);
+            out[begin] = acc;
+            for (size_t i = begin + 1; i < end; ++i) {
+                acc = op(acc, first[i]);
+                out[i] = acc;
+            }
+        }
+    });
+    return out + n;
+}
+
+template <class InputIt, class OutputIt>
+OutputIt ParallelInclusiveScan(Executor& executor, InputIt first, InputIt last, OutputIt out) {
+    return ParallelInclusiveScan(executor, first, last, out, std::plus<>{});
+}
+
+template <class InputIt, class OutputIt, class T, class BinaryOp>
+OutputIt ParallelExclusiveScan(Executor& executor, InputIt first, InputIt last, OutputIt out,
+                               T init, BinaryOp op) {
+    const size_t n = last - first;
+    if (n < detail::kParallelScanThreshold || executor.NumThreads() < 2) {
+        return std::exclusive_scan(first, last, out, init, op);
+    }
+
+    const size_t num_blocks = detail::ScanBlockCount(executor, n);
+    const size_t block_size = (n + num_blocks - 1) / num_blocks;
+    std::vector<CacheLinePadded<T>> carry(num_blocks);
+
+    ParallelFor(executor, 0, num_blocks - 1, 1, [&](size_t lo, size_t hi) {
+        for (size_t block = lo; block < hi; ++block) {
+            size_t begin = block * block_size;
+            size_t end = std::min(n, begin + block_size);
+            carry[block + 1].value =
+                detail::ReduceBlock(first, begin + 1, end, T(first[begin]), op);
+        }
+    });
+    carry[0].value = init;
+    for (size_t block = 1; block < num_blocks; ++block) {
+        carry[block].value = op(carry[block - 1].value, carry[block].value);
+    }
+
+    ParallelFor(executor, 0, num_blocks, 1, [&](size_t lo, size_t hi) {
+        for (size_t block = lo; block < hi; ++block) {
+            size_t begin = block * block_size;
+            size_t end = std::min(n, begin + block_size);
+            T acc = carry[block].value;
+            for (size_t i = begin; i < end; ++i) {
+                // Read before write, the output is allowed to alias the input.
+                T next = op(acc, first[i]);
+                out[i] = acc;
+                acc = next;
+            }
+        }
+    });
+    return out + n;
+}
+
+template <class InputIt, class OutputIt, class T>
+OutputIt ParallelExclusiveScan(Executor& executor, InputIt first, InputIt last, OutputIt out,
+                               T init) {
+    return ParallelExclusiveScan(executor, first, last, out, init, std::plus<>{});
+}
+
+// Stream compaction: copies the elements satisfying `pred` to `out` preserving their order.
+// The first pass counts matches per block, the second one writes every block at its offset.
+// Output must not overlap the input.
+template <class InputIt, class OutputIt, class Predicate>
+OutputIt ParallelCopyIf(Executor& executor, InputIt first, InputIt last, OutputIt out,
+                        Predicate pred) {
+    const size_t n = last - first;
+    if (n < detail::kParallelScanThreshold || executor.NumThreads() < 2) {
+        return std::copy_if(first, last, out, pred);
+    }
+
+    const size_t num_blocks = detail::ScanBlockCount(executor, n);
+    const size_t block_size = (n + num_blocks - 1) / num_blocks;
+    std::vector<CacheLinePadded<size_t>> offsets(num_blocks + 1);
+
+    ParallelFor(executor, 0, num_blocks, 1, [&](size_t lo, size_t hi) {
+        for (size_t block = lo; block < hi; ++block) {
+            size_t begin = std::min(n, block * block_size);
+            size_t end = std::min(n, begin + block_size);
+            offsets[block + 1].value = detail::CountBlock(first, begin, end, pred);
+        }
+    });
+    for (size_t block = 1; block <= num_blocks; ++block) {
+        offsets[block].value += offsets[block - 1].value;
+    }
+
+    ParallelFor(executor, 0, num_blocks, 1, [&](size_t lo, size_t hi) {
+        for (size_t block = lo; block < hi; ++block) {
+            size_t begin = std::min(n, block * block_size);
+            size_t end = std::min(n, begin + block_size);
+            size_t position = offsets[block].value;
+            for (size_t i = begin; i < end; ++i) {
+                if (pred(first[i])) {
+                    out[position++] = first[i];
+                }
+            }
+        }
+    });
+    return out + offsets[num_blocks].value;
+}
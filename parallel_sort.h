@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+#include <executors.h>
+#include <parallel_for.h>
+
+namespace detail {
+
+// Inputs shorter than this are sorted with std::sort on the calling thread.
+inline constexpr size_t kParallelSortThreshold = 1 << 15;
+
+// Buckets are sized so that the final std::sort of every bucket runs inside L2.
+inline constexpr size_t kSortBucketBytes = 256 * 1024;
+// Range buckets; with the equality buckets the bucket index still fits in 16 bits.
+inline constexpr size_t kMaxSortBuckets = 4096;
+inline constexpr size_t kSortOversampling = 32;
+inline constexpr size_t kMinSortBlock = 1 << 14;
+
+}  // namespace detail
+
+// Sample sort on top of the executor. The input is cut into one block per task, every element is
+// classified against oversampled splitters, scattered into a bucket-major buffer and every bucket
+// is then sorted independently. A key that was picked as a splitter more than once is frequent:
+// elements equal to it get an equality bucket of their own, which needs no sorting, so inputs with
+// few distinct keys still spread over all threads. Needs a default constructible value type for
+// the buffer.
+// Blocks the calling thread until the range is sorted, see ParallelFor.
+template <class RandomIt, class Compare>
+void ParallelSort(Executor& executor, RandomIt first, RandomIt last, Compare comp) {
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+
+    const size_t n = last - first;
+    const size_t threads = executor.NumThreads();
+    if (n < detail::kParallelSortThreshold || threads < 2) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    const size_t num_blocks = std::min(threads * 4, n / detail::kMinSortBlock);
+    const size_t block_size = (n + num_blocks - 1) / num_blocks;
+    const size_t num_splitters = std::min(
+        std::max(n * sizeof(T) / detail::kSortBucketBytes, threads * 4), detail::kMaxSortBuckets);
+
+    // Regular sampling with a cheap xorshift jitter inside every stride, so that presorted or
+    // periodic inputs do not hand us degenerate splitters.
+    const size_t sample_size = std::min(n, num_splitters * detail::kSortOversampling);
+    const size_t stride = n / sample_size;
+    std::vector<T> sample;
+    sample.reserve(sample_size);
+    uint64_t state = 0x9E3779B97F4A7C15ull ^ n;
+    for (size_t i = 0; i < sample_size; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        sample.push_back(first[i * stride + (stride > 1 ? state % stride : 0)]);
+    }
+    std::sort(sample.begin(), sample.end(), comp);
+
+    // Distinct splitters, and whether each one was picked more than once.
+    std::vector<T> splitters;
+    std::vector<bool> frequent;
+    splitters.reserve(num_splitters - 1);
+    for (size_t i = 1; i < num_splitters; ++i) {
+        const T& splitter = sample[i * sample_size / num_splitters];
+        if (!splitters.empty() && !comp(splitters.back(), splitter)) {
+            frequent.back() = true;
+        } else {
+            splitters.push_back(splitter);
+            frequent.push_back(false);
+        }
+    }
+    sample = {};
+
+    // Bucket 2j holds the elements between splitters j - 1 and j, bucket 2j + 1 the ones equal to
+    // splitter j if it is frequent.
+    const size_t num_buckets = 2 * splitters.size() + 1;
+
+    // Pass 1: classify every element and count bucket sizes per block.
+    std::vector<uint16_t> bucket_of(n);
+    std::vector<size_t> offsets(num_blocks * num_buckets);
+    ParallelFor(executor, 0, num_blocks, 1, [&](size_t block_begin, size_t block_end) {
+        for (size_t block = block_begin; block < block_end; ++block) {
+            size_t* counts = &offsets[block * num_buckets];
+            size_t hi = std::min(n, (block + 1) * block_size);
+            for (size_t i = block * block_size; i < hi; ++i) {
+                size_t above =
+                    std::upper_bound(splitters.begin(), splitters.end(), first[i], comp) -
+                    splitters.begin();
+                size_t bucket = 2 * above;
+                if (above && frequent[above - 1] && !comp(splitters[above - 1], first[i])) {
+                    bucket = 2 * above - 1;
+                }
+                bucket_of[i] = static_cast<uint16_t>(bucket);
+                ++counts[bucket];
+            }
+        }
+    });
+
+    // Turn the counts into bucket-major write positions.
+    std::vector<size_t> bucket_begin(num_buckets + 1);
+    size_t position = 0;
+    for (size_t bucket = 0; bucket < num_buckets; ++bucket) {
+        bucket_begin[bucket] = position;
+        for (size_t block = 0; block < num_blocks; ++block) {
+            size_t count = offsets[block * num_buckets + bucket];
+            offsets[block * num_buckets + bucket] = position;
+            position += count;
+        }
+    }
+    bucket_begin[num_buckets] = n;
+
+    // Pass 2: scatter into the buffer.
+    std::vector<T> buffer(n);
+    ParallelFor(executor, 0, num_blocks, 1, [&](size_t block_begin, size_t block_end) {
+        for (size_t block = block_begin; block < block_end; ++block) {
+            size_t* positions = &offsets[block * num_buckets];
+            size_t hi = std::min(n, (block + 1) * block_size);
+            for (size_t i = block * block_size; i < hi; ++i) {
+                buffer[positions[bucket_of[i]]++] = std::move(first[i]);
+            }
+        }
+    });
+    bucket_of = {};
+
+    // Pass 3: sort every bucket and move it back.
+    const size_t grain = std::max<size_t>(1, num_buckets / (threads * 8));
+    ParallelFor(executor, 0, num_buckets, grain, [&](size_t lo, size_t hi) {
+        for (size_t bucket = lo; bucket < hi; ++bucket) {
+            auto begin = buffer.begin() + bucket_begin[bucket];
+            auto end = buffer.begin() + bucket_begin[bucket + 1];
+            if (bucket % 2 == 0) {
+                std::sort(begin, end, comp);
+            }
+            std::move(begin, end, first + bucket_begin[bucket]);
+        }
+    });
+}
+
+template <class RandomIt>
+void ParallelSort(Executor& executor, RandomIt first, RandomIt last) {
+    ParallelSort(executor, first, last, std::less<>{});
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <cache_line.h>
+
+// Memory reclamation for lock-free structures. An unlinked object is handed to Retire and deleted
+// once no thread can still be reading it:
+//
+// * Executor workers are online: they announce a quiescent state between tasks, when they hold no
+//   references into any structure, and are taken offline while idle. An object retired at epoch e
+//   is safe from them once every online thread has announced an epoch of at least e. Their reads
+//   cost a plain load, but a task that blocks for long delays reclamation for everyone.
+// * Every other thread is offline and publishes what it reads through hazard pointers.
+//
+// Structures always read shared pointers through HazardPointer::Protect, which picks the right
+// protocol for the calling thread. Pointers obtained inside a task must not be kept past its end.
+//
+// Threads get a record in the domain the first time they use it, and give it back on exit with
+// whatever they retired and could not free yet. A domain must outlive every thread that used it;
+// structures normally use EpochDomain::Global().
+class EpochDomain {
+public:
+    static constexpr size_t kHazardsPerThread = 4;
+
+    class Record;
+
+    EpochDomain() = default;
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    ~EpochDomain();
+
+    // Never destroyed: threads release their records when they exit, which for the workers of a
+    // static executor happens during static destruction, possibly after the domain's own.
+    static EpochDomain& Global() {
+        static auto* domain = new EpochDomain;
+        return *domain;
+    }
+
+    // Record of the calling thread.
+    Record& ThisThread();
+
+    // Deletes `object` once no thread can be reading it anymore.
+    template <class T>
+    void Retire(T* object);
+
+    // Deletes what the calling thread retired and is safe to delete, returns how many objects.
+    size_t Collect() {
+        return Collect(ThisThread());
+    }
+
+private:
+    friend class HazardPointer;
+
+    static constexpr uint64_t kOffline = UINT64_MAX;
+    static constexpr size_t kCollectThreshold = 64;
+
+    struct Retired {
+        void* pointer;
+        void (*deleter)(void*);
+        uint64_t epoch;
+    };
+
+    struct ThreadRecords;
+
+    Record* AcquireRecord();
+    void ReleaseRecord(Record* record);
+    size_t Collect(Record& record);
+
+    CacheLinePadded<std::atomic<uint64_t>> epoch_{1};
+    std::atomic<Record*> records_ = nullptr;
+    std::mutex orphans_mutex_;
+    std::vector<Retired> orphans_;
+};
+
+class EpochDomain::Record {
+public:
+    // Announces that the thread holds no references obtained before this call.
+    void Quiescent() {
+        epoch_.value.store(domain_->epoch_.value.load(std::memory_order_acquire),
+                           std::memory_order_release);
+        if (retired_.size() >= next_collect_) {
+            domain_->Collect(*this);
+        }
+    }
+
+    void Online() {
+        epoch_.value.store(domain_->epoch_.value.load(std::memory_order_acquire));
+        // Collectors either see the announcement or everything unlinked before their scan.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void Offline() {
+        epoch_.value.store(kOffline, std::memory_order_release);
+    }
+
+    bool IsOnline() const {
+        return epoch_.value.load(std::memory_order_relaxed) != kOffline;
+    }
+
+private:
+    friend class EpochDomain;
+    friend class HazardPointer;
+
+    void Retire(void* pointer, void (*deleter)(void*)) {
+        uint64_t epoch = domain_->epoch_.value.fetch_add(1) + 1;
+        retired_.push_back({pointer, deleter, epoch});
+        if (retired_.size() >= next_collect_) {
+            domain_->Collect(*this);
+        }
+    }
+
+    CacheLinePadded<std::atomic<uint64_t>> epoch_{kOffline};
+    std::array<std::atomic<void*>, kHazardsPerThread> hazards_{};
+    uint32_t free_hazards_ = (1u << kHazardsPerThread) - 1;
+    std::vector<Retired> retired_;
+    // Objects an online thread retires stay until it is quiescent, and others stay while a reader
+    // pins them, so a scan that freed little moves the next one further away instead of repeating
+    // on every Retire or quiescent state.
+    size_t next_collect_ = kCollectThreshold;
+    EpochDomain* domain_ = nullptr;
+    std::atomic<bool> in_use_ = false;
+    Record* next_ = nullptr;
+};
+
+// Releases the records of an exiting thread.
+struct EpochDomain::ThreadRecords {
+    std::vector<std::pair<EpochDomain*, Record*>> records;
+
+    ~ThreadRecords() {
+        for (auto [domain, record] : records) {
+            domain->ReleaseRecord(record);
+        }
+    }
+};
+
+template <class T>
+void EpochDomain::Retire(T* object) {
+    ThisThread().Retire(object, [](void* pointer) { delete static_cast<T*>(pointer); });
+}
+
+inline EpochDomain::~EpochDomain() {
+    for (Record* record = records_.load(); record;) {
+        for (auto& retired : record->retired_) {
+            retired.deleter(retired.pointer);
+        }
+        delete std::exchange(record, record->next_);
+    }
+    for (auto& retired : orphans_) {
+        retired.deleter(retired.pointer);
+    }
+}
+
+inline EpochDomain::Record& EpochDomain::ThisThread() {
+    thread_local ThreadRecords thread_records;
+    for (auto [domain, record] : thread_records.records) {
+        if (domain == this) {
+            return *record;
+        }
+    }
+    Record* record = AcquireRecord();
+    thread_records.records.emplace_back(this, record);
+    return *record;
+}
+
+inline EpochDomain::Record* EpochDomain::AcquireRecord() {
+    for (Record* record = records_.load(); record; record = record->next_) {
+        if (!record->in_use_.load() && !record->in_use_.exchange(true)) {
+            return record;
+        }
+    }
+    auto* record = new Record();
+    record->domain_ = this;
+    record->in_use_ = true;
+    record->next_ = records_.load();
+    while (!records_.compare_exchange_weak(record->next_, record)) {
+    }
+    return record;
+}
+
+inline void EpochDomain::ReleaseRecord(Record* record) {
+    record->Offline();
+    Collect(*record);
+    {
+        std::lock_guard guard(orphans_mutex_);
+        orphans_.insert(orphans_.end(), record->retired_.begin(), record->retired_.end());
+    }
+    record->retired_.clear();
+    record->free_hazards_ = (1u << kHazardsPerThread) - 1;
+    record->in_use_.store(false);
+}
+
+inline size_t EpochDomain::Collect(Record& self) {
+    if (std::unique_lock guard(orphans_mutex_, std::try_to_lock); guard && !orphans_.empty()) {
+        self.retired_.insert(self.retired_.end(), orphans_.begin(), orphans_.end());
+        orphans_.clear();
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t safe_epoch = kOffline;
+    std::vector<void*> hazards;
+    for (Record* record = records_.load(); record; record = record->next_) {
+        safe_epoch = std::min(safe_epoch, record->epoch_.value.load());
+        for (auto& hazard : record->hazards_) {
+            if (void* pointer = hazard.load()) {
+                hazards.push_back(pointer);
+            }
+        }
+    }
+    std::sort(hazards.begin(), hazards.end());
+
+    size_t kept = 0;
+    size_t freed = 0;
+    for (auto& retired : self.retired_) {
+        if (retired.epoch <= safe_epoch &&
+            !std::binary_search(hazards.begin(), hazards.end(), retired.pointer)) {
+            retired.deleter(retired.pointer);
+            ++freed;
+        } else {
+            self.retired_[kept++] = retired;
+        }
+    }
+    self.retired_.resize(kept);
+    self.next_collect_ = std::max(kCollectThreshold, 2 * kept);
+    return freed;
+}
+
+// One protected pointer of the calling thread. On online threads Protect is a plain load and no
+// hazard slot is taken. Every thread has kHazardsPerThread slots.
+class HazardPointer {
+public:
+    explicit HazardPointer(EpochDomain& domain = EpochDomain::Global())
+        : record_(&domain.ThisThread()) {
+    }
+
+    HazardPointer(const HazardPointer&) = delete;
+    HazardPointer& operator=(const HazardPointer&) = delete;
+
+    ~HazardPointer() {
+        if (slot_) {
+            Reset();
+            record_->free_hazards_ |= 1u << (slot_ - record_->hazards_.data());
+        }
+    }
+
+    // Loads `source` and keeps the object it points to from being deleted until Reset, the next
+    // Protect or the end of the current task.
+    template <class T>
+    T* Protect(const std::atomic<T*>& source) {
+        if (record_->IsOnline()) {
+            return source.load(std::memory_order_acquire);
+        }
+        if (!slot_) {
+            if (!record_->free_hazards_) {
+                throw std::runtime_error("HazardPointer: no free hazard slots left");
+            }
+            size_t index = std::countr_zero(record_->free_hazards_);
+            record_->free_hazards_ &= ~(1u << index);
+            slot_ = &record_->hazards_[index];
+        }
+        T* pointer = source.load();
+        while (true) {
+            slot_->store(pointer);
+            T* again = source.load();
+            if (again == pointer) {
+                return pointer;
+            }
+            pointer = again;
+        }
+    }
+
+    void Reset() {
+        if (slot_) {
+            slot_->store(nullptr, std::memory_order_release);
+        }
+    }
+
+private:
+    EpochDomain::Record* record_;
+    std::atomic<void*>* slot_ = nullptr;
+};
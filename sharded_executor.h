@@ -0,0 +1,454 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <cache_line.h>
+#include <executors.h>
+#include <spsc_ring.h>
+
+// Thread-per-core executor. Every shard has one worker, pinned to a core, and a run queue that only
+// this worker touches. Tasks go from one shard to another through an SPSC ring per ordered pair of
+// shards, which the receiver drains in batches, so shards share neither a lock nor a queue. Threads
+// that are not shards submit through a small locked inbox per shard.
+//
+// Tasks never move between shards: the submitter decides where a task runs. A task whose
+// dependencies are not finished yet is parked on one of them and sent back to its shard once it
+// has finished, the way ThenOn delivers a continuation to its shard.
+//
+// StartShutdown turns away submissions from threads that are not shards. Accepted tasks still run
+// and may keep submitting to shards until every shard is idle with no message in flight; then the
+// workers exit. Tasks parked on a dependency or waiting in ThenOn for an input that finishes later
+// than that, even after the executor is destroyed, are canceled.
+class ShardedExecutor {
+public:
+    static constexpr size_t kRingCapacity = 256;
+    // Messages taken from one ring per poll.
+    static constexpr size_t kPollBatch = 32;
+    // Empty polls before an idle worker goes to sleep.
+    static constexpr int kIdlePolls = 64;
+
+    explicit ShardedExecutor(size_t num_shards, bool pin_threads = true);
+
+    ShardedExecutor(const ShardedExecutor&) = delete;
+    ShardedExecutor& operator=(const ShardedExecutor&) = delete;
+
+    ~ShardedExecutor();
+
+    // Returns false if the task was not queued because it is canceled or the executor does not take
+    // tasks anymore.
+    bool SubmitTo(size_t shard, std::shared_ptr<Task> task);
+
+    // Submits to the calling shard, and round robin from other threads.
+    bool Submit(std::shared_ptr<Task> task);
+
+    template <class T>
+    FuturePtr<T> InvokeOn(size_t shard, std::function<T()> fn);
+
+    // Runs `fn` on `shard` after `input` has finished. Whoever finishes `input` sends it there.
+    template <class Y, class T>
+    FuturePtr<Y> ThenOn(size_t shard, FuturePtr<T> input, std::function<Y()> fn);
+
+    void StartShutdown();
+
+    // Must follow StartShutdown.
+    void WaitShutdown();
+
+    size_t NumThreads() const {
+        return shards_.size();
+    }
+
+private:
+    using Ring = SpscRing<std::shared_ptr<Task>, kRingCapacity>;
+
+    struct Shard;
+
+    void RunShard(size_t index);
+
+    void Poll(size_t index);
+
+    void FlushOverflow(size_t index);
+
+    void Execute(Shard& shard, std::shared_ptr<Task> task);
+
+    // Returns false once the executor has stopped.
+    bool Park(size_t index);
+
+    bool HasInput(size_t index);
+
+    void Wake(Shard& shard);
+
+    bool IsQuiescent();
+
+    // Sends `task` to `shard` once `input` has finished.
+    void SubmitWhenFinished(Task& input, size_t shard, std::shared_ptr<Task> task);
+
+    // Lets callbacks outlive the executor: once it is gone, they cancel their task instead.
+    struct Parking {
+        ShardedExecutor* executor;
+        std::shared_mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<size_t> next_shard_ = 0;
+    std::atomic<bool> closing_ = false;
+    std::atomic<bool> stopped_ = false;
+    // Bumped by shards that go idle during shutdown, WaitShutdown sleeps on it.
+    std::atomic<uint64_t> idle_events_ = 0;
+    std::mutex shutdown_mutex_;
+    std::shared_ptr<Parking> parking_ = std::make_shared<Parking>(this);
+    std::vector<std::jthread> workers_;
+};
+
+struct ShardedExecutor::Shard {
+    explicit Shard(size_t num_shards) : inbound(num_shards), overflow(num_shards) {
+        for (auto& ring : inbound) {
+            ring = std::make_unique<Ring>();
+        }
+    }
+
+    // Indexed by sender.
+    std::vector<std::unique_ptr<Ring>> inbound;
+
+    // Touched by the worker only.
+    std::deque<std::shared_ptr<Task>> run_queue;
+    // Indexed by receiver: messages that did not fit into its ring yet.
+    std::vector<std::deque<std::shared_ptr<Task>>> overflow;
+    size_t overflow_size = 0;
+
+    std::mutex external_mutex;
+    std::vector<std::shared_ptr<Task>> external;
+    bool external_closed = false;
+    std::atomic<bool> has_external = false;
+
+    CacheLinePadded<std::atomic<uint64_t>> wake;
+    std::atomic<bool> sleeping = false;
+
+    // Termination detection. The worker writes `sent`, `received` and `busy`; a shard only
+    // receives while busy, and all counters only grow.
+    CacheLinePadded<std::atomic<uint64_t>> sent;
+    std::atomic<uint64_t> received = 0;
+    std::atomic<uint64_t> external_sent = 0;
+    std::atomic<bool> busy = true;
+};
+
+inline ShardedExecutor::ShardedExecutor(size_t num_shards, bool pin_threads) {
+    if (num_shards == 0) {
+        throw std::invalid_argument("ShardedExecutor: needs at least one shard");
+    }
+    for (size_t i = 0; i < num_shards; ++i) {
+        shards_.push_back(std::make_unique<Shard>(num_shards));
+    }
+    size_t num_cores = std::max(1u, std::thread::hardware_concurrency());
+    workers_.reserve(num_shards);
+    for (size_t i = 0; i < num_shards; ++i) {
+        workers_.emplace_back([this, i] { RunShard(i); });
+        if (pin_threads) {
+            // Best effort: a worker that cannot be pinned still runs.
+            cpu_set_t cores;
+            CPU_ZERO(&cores);
+            CPU_SET(i % num_cores, &cores);
+            pthread_setaffinity_np(workers_.back().native_handle(), sizeof(cores), &cores);
+        }
+    }
+}
+
+inline ShardedExecutor::~ShardedExecutor() {
+    StartShutdown();
+    WaitShutdown();
+    std::lock_guard guard(parking_->mutex);
+    parking_->executor = nullptr;
+}
+
+inline bool ShardedExecutor::SubmitTo(size_t shard, std::shared_ptr<Task> task) {
+    if (shard >= shards_.size()) {
+        throw std::out_of_range("ShardedExecutor: no such shard");
+    }
+    if (task->IsCanceled()) {
+        return false;
+    }
+    auto& receiver = *shards_[shard];
+
+    if (detail::current_worker.executor == this) {
+        size_t from = detail::current_worker.index;
+        auto& sender = *shards_[from];
+        if (from == shard) {
+            sender.run_queue.push_back(std::move(task));
+            return true;
+        }
+        sender.sent.value.store(sender.sent.value.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_release);
+        auto& overflow = sender.overflow[shard];
+        if (!overflow.empty() || !receiver.inbound[from]->TryPush(std::move(task))) {
+            overflow.push_back(std::move(task));
+            ++sender.overflow_size;
+            return true;
+        }
+        Wake(receiver);
+        return true;
+    }
+
+    {
+        std::lock_guard guard(receiver.external_mutex);
+        if (receiver.external_closed) {
+            task->Cancel();
+            return false;
+        }
+        receiver.external.push_back(std::move(task));
+        receiver.external_sent.fetch_add(1);
+        receiver.has_external.store(true);
+    }
+    Wake(receiver);
+    return true;
+}
+
+inline bool ShardedExecutor::Submit(std::shared_ptr<Task> task) {
+    size_t shard = detail::current_worker.executor == this
+                       ? detail::current_worker.index
+                       : next_shard_.fetch_add(1, std::memory_order_relaxed) % shards_.size();
+    return SubmitTo(shard, std::move(task));
+}
+
+template <class T>
+FuturePtr<T> ShardedExecutor::InvokeOn(size_t shard, std::function<T()> fn) {
+    auto future = std::make_shared<Future<T>>(std::move(fn));
+    SubmitTo(shard, future);
+    return future;
+}
+
+template <class Y, class T>
+FuturePtr<Y> ShardedExecutor::ThenOn(size_t shard, FuturePtr<T> input, std::function<Y()> fn) {
+    if (shard >= shards_.size()) {
+        throw std::out_of_range("ShardedExecutor: no such shard");
+    }
+    auto future = std::make_shared<Future<Y>>(std::move(fn));
+    SubmitWhenFinished(*input, shard, future);
+    return future;
+}
+
+inline void ShardedExecutor::SubmitWhenFinished(Task& input, size_t shard,
+                                                std::shared_ptr<Task> task) {
+    input.OnFinish([parking = parking_, shard, task = std::move(task)] {
+        bool queued = false;
+        {
+            std::shared_lock guard(parking->mutex);
+            queued = parking->executor && parking->executor->SubmitTo(shard, task);
+        }
+        if (!queued) {
+            task->Cancel();
+        }
+    });
+}
+
+inline void ShardedExecutor::StartShutdown() {
+    for (auto& shard : shards_) {
+        std::lock_guard guard(shard->external_mutex);
+        shard->external_closed = true;
+    }
+    closing_.store(true);
+    for (auto& shard : shards_) {
+        Wake(*shard);
+    }
+}
+
+// Waits until two consecutive scans find every shard idle and as many messages received as sent,
+// with no counter changed in between; then no task is left anywhere and none can appear.
+inline void ShardedExecutor::WaitShutdown() {
+    std::lock_guard guard(shutdown_mutex_);
+    if (stopped_.load()) {
+        return;
+    }
+    while (true) {
+        auto key = idle_events_.load();
+        if (IsQuiescent()) {
+            break;
+        }
+        idle_events_.wait(key);
+    }
+    stopped_.store(true);
+    for (auto& shard : shards_) {
+        shard->wake.value.fetch_add(1);
+        shard->wake.value.notify_one();
+    }
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+inline bool ShardedExecutor::IsQuiescent() {
+    struct Scan {
+        uint64_t sent = 0;
+        uint64_t received = 0;
+        bool idle = true;
+
+        bool operator==(const Scan&) const = default;
+    };
+    auto scan = [this] {
+        Scan result;
+        for (auto& shard : shards_) {
+            result.received += shard->received.load();
+            result.sent += shard->sent.value.load() + shard->external_sent.load();
+            result.idle = result.idle && !shard->busy.load() && !shard->has_external.load();
+        }
+        return result;
+    };
+    Scan first = scan();
+    return first.idle && first.sent == first.received && scan() == first;
+}
+
+inline void ShardedExecutor::RunShard(size_t index) {
+    detail::current_worker = {this, index};
+    auto& shard = *shards_[index];
+    int idle_polls = 0;
+    while (true) {
+        Poll(index);
+        FlushOverflow(index);
+        // Tasks submitted to this shard by the ones run now wait for the next round.
+        size_t count = shard.run_queue.size();
+        for (size_t i = 0; i < count; ++i) {
+            auto task = std::move(shard.run_queue.front());
+            shard.run_queue.pop_front();
+            Execute(shard, std::move(task));
+        }
+        if (count || shard.overflow_size || ++idle_polls < kIdlePolls) {
+            if (!count) {
+                std::this_thread::yield();
+            } else {
+                idle_polls = 0;
+            }
+            continue;
+        }
+        idle_polls = 0;
+        if (!Park(index)) {
+            return;
+        }
+    }
+}
+
+inline void ShardedExecutor::Poll(size_t index) {
+    auto& shard = *shards_[index];
+    uint64_t received = 0;
+    auto enqueue = [&shard](std::shared_ptr<Task>&& task) {
+        shard.run_queue.push_back(std::move(task));
+    };
+    for (size_t from = 0; from < shards_.size(); ++from) {
+        if (from != index) {
+            received += shard.inbound[from]->PopBatch(kPollBatch, enqueue);
+        }
+    }
+    if (shard.has_external.load(std::memory_order_relaxed)) {
+        std::lock_guard guard(shard.external_mutex);
+        for (auto& task : shard.external) {
+            shard.run_queue.push_back(std::move(task));
+        }
+        received += shard.external.size();
+        shard.external.clear();
+        shard.has_external.store(false);
+    }
+    if (received) {
+        shard.received.store(shard.received.load(std::memory_order_relaxed) + received);
+    }
+}
+
+inline void ShardedExecutor::FlushOverflow(size_t index) {
+    auto& shard = *shards_[index];
+    if (!shard.overflow_size) {
+        return;
+    }
+    for (size_t to = 0; to < shards_.size(); ++to) {
+        auto& overflow = shard.overflow[to];
+        bool pushed = false;
+        auto& ring = *shards_[to]->inbound[index];
+        while (!overflow.empty() && ring.TryPush(std::move(overflow.front()))) {
+            overflow.pop_front();
+            --shard.overflow_size;
+            pushed = true;
+        }
+        if (pushed) {
+            Wake(*shards_[to]);
+        }
+    }
+}
+
+inline void ShardedExecutor::Execute(Shard& shard, std::shared_ptr<Task> task) {
+    if (task->IsCanceled()) {
+        return;
+    }
+    if (!task->CanBeExecuted()) {
+        // Only tasks waiting for a trigger or a point in time are polled.
+        if (auto dependency = task->UnfinishedDependency()) {
+            SubmitWhenFinished(*dependency, detail::current_worker.index, std::move(task));
+        } else {
+            shard.run_queue.push_back(std::move(task));
+        }
+        return;
+    }
+    if (!task->TryStart()) {
+        return;
+    }
+    try {
+        if (task->run_function_) {
+            task->run_function_(task.get());
+        } else {
+            task->Run();
+        }
+        task->CompleteTask();
+    } catch (...) {
+        task->SaveError(std::current_exception());
+    }
+}
+
+inline bool ShardedExecutor::Park(size_t index) {
+    auto& shard = *shards_[index];
+    shard.busy.store(false);
+    if (closing_.load()) {
+        idle_events_.fetch_add(1);
+        idle_events_.notify_all();
+    }
+    auto key = shard.wake.value.load();
+    shard.sleeping.store(true);
+    // Senders either see `sleeping` or their message is seen by HasInput.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!HasInput(index) && !stopped_.load()) {
+        shard.wake.value.wait(key);
+    }
+    shard.sleeping.store(false);
+    if (stopped_.load()) {
+        return false;
+    }
+    shard.busy.store(true);
+    return true;
+}
+
+inline bool ShardedExecutor::HasInput(size_t index) {
+    auto& shard = *shards_[index];
+    if (shard.has_external.load()) {
+        return true;
+    }
+    for (size_t from = 0; from < shards_.size(); ++from) {
+        if (from != index && !shard.inbound[from]->Empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void ShardedExecutor::Wake(Shard& shard) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (shard.sleeping.load(std::memory_order_relaxed)) {
+        shard.wake.value.fetch_add(1);
+        shard.wake.value.notify_one();
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 2^64 divided by the golden ratio, for Fibonacci hashing.
+inline constexpr uint64_t kShardHashMultiplier = 0x9E3779B97F4A7C15ull;
+
+// Shard out of `num_shards` that a key with hash `hash` belongs to. The hash is mixed first:
+// std::hash of integers is the identity, and keys differing only in high bits would collide.
+inline size_t ShardIndex(size_t hash, size_t num_shards) {
+    return static_cast<size_t>((hash * kShardHashMultiplier) >> 32) % num_shards;
+}
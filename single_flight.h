@@ -0,0 +1,70 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <cache_line.h>
+#include <executors.h>
+#include <sharding.h>
+
+// Collapses concurrent computations of the same key into one. The first caller for a key starts
+// the computation on the executor, everyone who asks for the key while it is in flight gets the
+// same future. The key is forgotten as soon as the computation finishes, so later callers start a
+// fresh one; InvokeCache keeps finished results around.
+//
+// Keys are spread over independently locked shards, each on its own cache line, so unrelated keys
+// do not contend. Must outlive the computations it started.
+template <class Key, class T, class Hash = std::hash<Key>>
+class SingleFlight {
+public:
+    explicit SingleFlight(std::shared_ptr<Executor> executor, size_t num_shards = 64)
+        : executor_(std::move(executor)), shards_(num_shards) {
+    }
+
+    FuturePtr<T> Do(const Key& key, std::function<T()> fn) {
+        auto& shard = ShardFor(key);
+        std::unique_lock lock(shard.mutex);
+        if (auto it = shard.calls.find(key); it != shard.calls.end()) {
+            return it->second;
+        }
+
+        auto call = std::make_shared<Future<T>>(std::move(fn));
+        shard.calls.emplace(key, call);
+        lock.unlock();
+
+        call->OnFinish([&shard, key, call = call.get()] {
+            std::unique_lock lock(shard.mutex);
+            auto it = shard.calls.find(key);
+            if (it != shard.calls.end() && it->second.get() == call) {
+                shard.calls.erase(it);
+            }
+        });
+        executor_->Submit(call);
+        return call;
+    }
+
+    size_t InFlight() {
+        size_t count = 0;
+        for (auto& shard : shards_) {
+            std::unique_lock lock(shard.value.mutex);
+            count += shard.value.calls.size();
+        }
+        return count;
+    }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, FuturePtr<T>, Hash> calls;
+    };
+
+    Shard& ShardFor(const Key& key) {
+        return shards_[ShardIndex(Hash{}(key), shards_.size())].value;
+    }
+
+    std::shared_ptr<Executor> executor_;
+    std::vector<CacheLinePadded<Shard>> shards_;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+#include <cache_line.h>
+
+// Bounded queue for exactly one producer thread and one consumer thread. Each side owns one index
+// and keeps a cached copy of the other one, so it only reads the other side's cache line when the
+// ring looks full or holds less than a batch. PopBatch publishes its progress once per batch.
+template <class T, size_t kCapacity>
+class SpscRing {
+    static_assert(kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0,
+                  "SpscRing: capacity must be a power of two");
+
+public:
+    // Moves from `value` only if there was room.
+    bool TryPush(T&& value) {
+        size_t tail = tail_.value.load(std::memory_order_relaxed);
+        if (tail - producer_.value.cached_head == kCapacity) {
+            producer_.value.cached_head = head_.value.load(std::memory_order_acquire);
+            if (tail - producer_.value.cached_head == kCapacity) {
+                return false;
+            }
+        }
+        slots_[tail & (kCapacity - 1)] = std::move(value);
+        tail_.value.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Hands up to `max_count` elements to `consume` in FIFO order, returns how many.
+    template <class F>
+    size_t PopBatch(size_t max_count, F&& consume) {
+        size_t head = head_.value.load(std::memory_order_relaxed);
+        if (consumer_.value.cached_tail - head < max_count) {
+            consumer_.value.cached_tail = tail_.value.load(std::memory_order_acquire);
+        }
+        size_t count = std::min(consumer_.value.cached_tail - head, max_count);
+        for (size_t i = 0; i < count; ++i) {
+            consume(std::move(slots_[(head + i) & (kCapacity - 1)]));
+        }
+        if (count) {
+            head_.value.store(head + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    // Exact for the consumer, a snapshot for anyone else.
+    bool Empty() const {
+        return head_.value.load(std::memory_order_acquire) ==
+               tail_.value.load(std::memory_order_acquire);
+    }
+
+private:
+    struct ProducerState {
+        size_t cached_head = 0;
+    };
+
+    struct ConsumerState {
+        size_t cached_tail = 0;
+    };
+
+    CacheLinePadded<std::atomic<size_t>> head_;
+    CacheLinePadded<std::atomic<size_t>> tail_;
+    CacheLinePadded<ProducerState> producer_;
+    CacheLinePadded<ConsumerState> consumer_;
+    std::array<T, kCapacity> slots_{};
+};
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <executors.h>
+
+// Task graphs whose shape is known at compile time:
+//
+//     using Graph = static_graph::Graph<
+//         static_graph::Node<Parse>,
+//         static_graph::Node<Lookup, static_graph::Deps<Parse>>,
+//         static_graph::Node<Render, static_graph::Deps<Parse, Lookup>>>;
+//
+// Nodes are identified by their function type. A node is called with the results of its
+// dependencies, in the order they are listed, and its result is stored inline in the graph.
+// Unknown dependencies and cycles are compile errors; in-degrees, successors and topological layers
+// are constants.
+namespace static_graph {
+
+template <class... Functions>
+struct Deps {};
+
+template <class F, class D = Deps<>>
+struct Node {
+    using Function = F;
+    using Dependencies = D;
+};
+
+namespace detail {
+
+template <class F, class... Functions>
+constexpr size_t IndexOf() {
+    constexpr bool kMatches[] = {std::is_same_v<F, Functions>..., false};
+    for (size_t i = 0; i < sizeof...(Functions); ++i) {
+        if (kMatches[i]) {
+            return i;
+        }
+    }
+    return sizeof...(Functions);
+}
+
+}  // namespace detail
+
+// Run() blocks until every node has finished; a graph runs once at a time but can be run again.
+// After a node fails, the nodes that have not started are skipped and Run rethrows the first error.
+template <class... Nodes>
+class Graph {
+public:
+    static constexpr size_t kSize = sizeof...(Nodes);
+
+    template <class F>
+    static constexpr size_t kIndex = detail::IndexOf<F, typename Nodes::Function...>();
+
+private:
+    template <class D>
+    struct DepIndices;
+
+    template <class... Functions>
+    struct DepIndices<Deps<Functions...>> {
+        static constexpr std::array<size_t, sizeof...(Functions)> kValue = {
+            kIndex<Functions>...};
+    };
+
+    template <size_t I>
+    using NodeAt = std::tuple_element_t<I, std::tuple<Nodes...>>;
+
+    template <size_t I>
+    static constexpr const auto& kDepsOf = DepIndices<typename NodeAt<I>::Dependencies>::kValue;
+
+    static constexpr bool DepsAreKnown() {
+        bool known = true;
+        ((known = known && std::ranges::all_of(DepIndices<typename Nodes::Dependencies>::kValue,
+                                               [](size_t dep) { return dep < kSize; })),
+         ...);
+        return known;
+    }
+
+    static constexpr bool FunctionsAreUnique() {
+        size_t indices[] = {kIndex<typename Nodes::Function>..., 0};
+        for (size_t i = 0; i < kSize; ++i) {
+            if (indices[i] != i) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(FunctionsAreUnique(), "static_graph: every node needs its own function type");
+    static_assert(DepsAreKnown(), "static_graph: dependency is not a node of the graph");
+
+    // kDependsOn[i][j]: node i depends on node j.
+    static constexpr auto kDependsOn = [] {
+        std::array<std::array<bool, kSize>, kSize> depends_on{};
+        size_t i = 0;
+        auto add = [&](const auto& deps) {
+            for (size_t dep : deps) {
+                depends_on[i][dep] = true;
+            }
+            ++i;
+        };
+        (add(DepIndices<typename Nodes::Dependencies>::kValue), ...);
+        return depends_on;
+    }();
+
+    // Longest path from a source, kSize for nodes on or behind a cycle.
+    static constexpr auto kLayers = [] {
+        std::array<size_t, kSize> layers{};
+        layers.fill(kSize);
+        for (size_t round = 0; round < kSize; ++round) {
+            for (size_t i = 0; i < kSize; ++i) {
+                size_t layer = 0;
+                for (size_t j = 0; j < kSize; ++j) {
+                    if (kDependsOn[i][j]) {
+                        layer = std::max(layer, layers[j] + 1);
+                    }
+                }
+                layers[i] = std::min(layer, kSize);
+            }
+        }
+        return layers;
+    }();
+
+    static_assert(std::ranges::all_of(kLayers, [](size_t layer) { return layer < kSize; }),
+                  "static_graph: dependencies form a cycle");
+
+    static constexpr auto kInDegrees = [] {
+        std::array<size_t, kSize> in_degrees{};
+        for (size_t i = 0; i < kSize; ++i) {
+            in_degrees[i] = std::ranges::count(kDependsOn[i], true);
+        }
+        return in_degrees;
+    }();
+
+    struct Successors {
+        std::array<size_t, kSize> nodes{};
+        size_t count = 0;
+    };
+
+    static constexpr auto kSuccessors = [] {
+        std::array<Successors, kSize> successors{};
+        for (size_t i = 0; i < kSize; ++i) {
+            for (size_t j = 0; j < kSize; ++j) {
+                if (kDependsOn[i][j]) {
+                    successors[j].nodes[successors[j].count++] = i;
+                }
+            }
+        }
+        return successors;
+    }();
+
+    template <size_t I, class D = typename NodeAt<I>::Dependencies>
+    struct ResultOf;
+
+    template <size_t I, class... Functions>
+    struct ResultOf<I, Deps<Functions...>> {
+        using Raw = std::invoke_result_t<typename NodeAt<I>::Function&,
+                                         const typename ResultOf<kIndex<Functions>>::Type&...>;
+        using Type = std::conditional_t<std::is_void_v<Raw>, Unit, Raw>;
+    };
+
+    template <size_t... Is>
+    static auto MakeResults(std::index_sequence<Is...>)
+        -> std::tuple<std::optional<typename ResultOf<Is>::Type>...>;
+
+    using Results = decltype(MakeResults(std::make_index_sequence<kSize>{}));
+
+public:
+    template <class F>
+    static constexpr size_t kLayer = kLayers[kIndex<F>];
+
+    template <class F>
+    static constexpr size_t kInDegree = kInDegrees[kIndex<F>];
+
+    template <class F>
+    using Result = typename ResultOf<kIndex<F>>::Type;
+
+    Graph() = default;
+
+    explicit Graph(typename Nodes::Function... functions) : functions_(std::move(functions)...) {
+    }
+
+    void Run(Executor& executor) {
+        executor_ = &executor;
+        results_ = Results{};
+        error_ = nullptr;
+        failed_ = false;
+        for (size_t i = 0; i < kSize; ++i) {
+            pending_deps_[i] = kInDegrees[i];
+        }
+        remaining_ = kSize;
+        done_ = false;
+
+        for (size_t i = 0; i < kSize; ++i) {
+            if (kInDegrees[i] == 0) {
+                Launch(i);
+            }
+        }
+        {
+            std::unique_lock lock(done_mutex_);
+            done_cv_.wait(lock, [this] { return done_; });
+        }
+        if (failed_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    // Result of node F from the last successful Run.
+    template <class F>
+    const Result<F>& Get() const {
+        return *std::get<kIndex<F>>(results_);
+    }
+
+private:
+    void Launch(size_t node) {
+        auto task = MakeFunctionTask([this, node] { (this->*kRunners[node])(); });
+        if (!executor_->Submit(task)) {
+            auto error = std::runtime_error("static_graph: executor is shut down");
+            Fail(std::make_exception_ptr(error));
+            (this->*kRunners[node])();
+        }
+    }
+
+    template <size_t I>
+    void RunNode() {
+        if (!failed_.load()) {
+            try {
+                Compute<I>(std::make_index_sequence<kDepsOf<I>.size()>{});
+            } catch (...) {
+                Fail(std::current_exception());
+            }
+        }
+
+        const auto& successors = kSuccessors[I];
+        for (size_t k = 0; k < successors.count; ++k) {
+            if (pending_deps_[successors.nodes[k]].fetch_sub(1) == 1) {
+                Launch(successors.nodes[k]);
+            }
+        }
+        if (remaining_.fetch_sub(1) == 1) {
+            // Notified under the lock: Run cannot return, and the graph cannot be destroyed, before
+            // the last node is done touching it.
+            std::lock_guard guard(done_mutex_);
+            done_ = true;
+            done_cv_.notify_all();
+        }
+    }
+
+    template <size_t I, size_t... Ks>
+    void Compute(std::index_sequence<Ks...>) {
+        auto& function = std::get<I>(functions_);
+        auto& result = std::get<I>(results_);
+        if constexpr (std::is_void_v<typename ResultOf<I>::Raw>) {
+            function(*std::get<kDepsOf<I>[Ks]>(results_)...);
+            result.emplace();
+        } else {
+            result.emplace(function(*std::get<kDepsOf<I>[Ks]>(results_)...));
+        }
+    }
+
+    void Fail(std::exception_ptr error) {
+        std::lock_guard guard(error_mutex_);
+        if (!failed_.exchange(true)) {
+            error_ = std::move(error);
+        }
+    }
+
+    template <size_t... Is>
+    static constexpr auto MakeRunners(std::index_sequence<Is...>) {
+        return std::array<void (Graph::*)(), kSize>{&Graph::RunNode<Is>...};
+    }
+
+    static constexpr auto kRunners = MakeRunners(std::make_index_sequence<kSize>{});
+
+    std::tuple<typename Nodes::Function...> functions_;
+    Results results_;
+    Executor* executor_ = nullptr;
+    std::array<std::atomic<size_t>, kSize> pending_deps_;
+    std::atomic<size_t> remaining_ = 0;
+    std::mutex done_mutex_;
+    std::condition_variable done_cv_;
+    bool done_ = false;
+    std::atomic<bool> failed_ = false;
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+};
+
+}  // namespace static_graph
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <execution.h>
+
+struct ExecutionTest : public ::testing::Test {
+    std::shared_ptr<Executor> pool;
+
+    ExecutionTest() {
+        pool = MakeThreadPoolExecutor(2);
+    }
+};
+
+TEST_F(ExecutionTest, ScheduleRunsOnPool) {
+    auto caller = std::this_thread::get_id();
+    auto result = execution::SyncWait(execution::Schedule(*pool) |
+                                      execution::Then([] { return std::this_thread::get_id(); }));
+    ASSERT_TRUE(result.has_value());
+    EXPECT_NE(*result, caller);
+}
+
+TEST_F(ExecutionTest, ThenChain) {
+    auto result = execution::SyncWait(
+        execution::Schedule(*pool) | execution::Then([] { return 1; }) |
+        execution::Then([](int x) { return x + 1; }) |
+        execution::Then([](int x) { return std::to_string(x); }));
+    EXPECT_EQ(*result, "2");
+}
+
+TEST_F(ExecutionTest, ThenStagesRunInline) {
+    std::thread::id first, second;
+    execution::SyncWait(execution::Schedule(*pool) |
+                        execution::Then([&] { first = std::this_thread::get_id(); }) |
+                        execution::Then([&] { second = std::this_thread::get_id(); }));
+    EXPECT_EQ(first, second);
+}
+
+TEST_F(ExecutionTest, Bulk) {
+    std::vector<int> out(10);
+    auto result = execution::SyncWait(execution::Schedule(*pool) |
+                                      execution::Then([] { return 3; }) |
+                                      execution::Bulk(out.size(), [&](size_t i, int x) {
+                                          out[i] = static_cast<int>(i) * x;
+                                      }));
+    EXPECT_EQ(*result, 3);
+    for (size_t i = 0; i < out.size(); ++i) {
+        EXPECT_EQ(out[i], static_cast<int>(i) * 3);
+    }
+}
+
+TEST_F(ExecutionTest, ErrorSkipsRemainingStages) {
+    bool reached = false;
+    auto sender = execution::Schedule(*pool) |
+                  execution::Then([]() -> int { throw std::logic_error("Test"); }) |
+                  execution::Then([&](int x) {
+                      reached = true;
+                      return x;
+                  });
+    EXPECT_THROW(execution::SyncWait(std::move(sender)), std::logic_error);
+    EXPECT_FALSE(reached);
+}
+
+TEST_F(ExecutionTest, WhenAllRunsInParallel) {
+    auto start = std::chrono::steady_clock::now();
+    auto slow = [](int x) {
+        return [x] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            return x;
+        };
+    };
+    auto result = execution::SyncWait(
+        execution::WhenAll(execution::Schedule(*pool) | execution::Then(slow(1)),
+                           execution::Schedule(*pool) | execution::Then(slow(2))) |
+        execution::Then([](std::tuple<int, int> values) {
+            return std::get<0>(values) + std::get<1>(values);
+        }));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(*result, 3);
+    EXPECT_LT(elapsed, std::chrono::milliseconds(90));
+}
+
+TEST_F(ExecutionTest, WhenAllPropagatesError) {
+    auto fail = []() -> int { throw std::logic_error("Test"); };
+    auto sender =
+        execution::WhenAll(execution::Schedule(*pool) | execution::Then([] { return 1; }),
+                           execution::Schedule(*pool) | execution::Then(fail));
+    EXPECT_THROW(execution::SyncWait(std::move(sender)), std::logic_error);
+}
+
+TEST_F(ExecutionTest, ShutdownStopsPipeline) {
+    pool->StartShutdown();
+    auto result =
+        execution::SyncWait(execution::Schedule(*pool) | execution::Then([] { return 1; }));
+    EXPECT_FALSE(result.has_value());
+}
+
+TEST_F(ExecutionTest, ToFuture) {
+    auto future = execution::ToFuture(execution::Schedule(*pool) |
+                                      execution::Then([] { return std::string("Hello World"); }));
+    EXPECT_EQ(future->Get(), "Hello World");
+
+    auto fail = []() -> int { throw std::logic_error("Test"); };
+    auto failed = execution::ToFuture(execution::Schedule(*pool) | execution::Then(fail));
+    EXPECT_THROW(failed->Get(), std::logic_error);
+}
+
+TEST_F(ExecutionTest, ToFutureOutlivesDroppedHandle) {
+    std::atomic<bool> done{false};
+    execution::ToFuture(execution::Schedule(*pool) | execution::Then([&] {
+                            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                            done = true;
+                        }));
+    while (!done) {
+        std::this_thread::yield();
+    }
+}
+
+TEST_F(ExecutionTest, FromFuture) {
+    auto future = pool->Invoke<int>([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return 20;
+    });
+    auto result = execution::SyncWait(execution::FromFuture(*pool, future) |
+                                      execution::Then([](int x) { return x + 1; }));
+    EXPECT_EQ(*result, 21);
+}
@@ -3,6 +3,12 @@
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 
 #include <executors.h>
 
@@ -167,6 +173,49 @@ TEST_P(ExecutorsTest, CanceledDependencyIsConsideredCompleted) {
     EXPECT_TRUE(task->IsFinished());
 }
 
+TEST_P(ExecutorsTest, FinishCallbacks) {
+    auto task = std::make_shared<TestTask>();
+    auto failing = std::make_shared<FailingTestTask>();
+    auto canceled = std::make_shared<TestTask>();
+    std::atomic<int> calls{0};
+
+    task->OnFinish([&] { calls++; });
+    failing->OnFinish([&] { calls++; });
+    canceled->OnFinish([&] { calls++; });
+
+    pool->Submit(task);
+    pool->Submit(failing);
+    canceled->Cancel();
+
+    task->Wait();
+    failing->Wait();
+    while (calls < 3) {
+        std::this_thread::yield();
+    }
+
+    task->OnFinish([&] { calls++; });
+    EXPECT_EQ(calls, 4);
+}
+
+TEST_P(ExecutorsTest, FunctionTask) {
+    int value = 0;
+    auto dependency = std::make_shared<TestTask>();
+    auto task = MakeFunctionTask([&] { value = dependency->completed ? 1 : 2; });
+    task->AddDependency(dependency);
+
+    pool->Submit(task);
+    pool->Submit(dependency);
+
+    task->Wait();
+    EXPECT_TRUE(task->IsCompleted());
+    EXPECT_EQ(value, 1);
+
+    auto failing = MakeFunctionTask([] { throw std::logic_error("Failed"); });
+    pool->Submit(failing);
+    failing->Wait();
+    EXPECT_TRUE(failing->IsFailed());
+}
+
 struct RecursiveTask : public Task {
     RecursiveTask(int n, std::shared_ptr<Executor> executor) : n_(n), executor_(executor) {
     }
@@ -390,3 +439,369 @@ INSTANTIATE_TEST_CASE_P(ThreadPool, ExecutorsTest,
                         ::testing::Values([] { return MakeThreadPoolExecutor(1); },
                                           [] { return MakeThreadPoolExecutor(2); },
                                           [] { return MakeThreadPoolExecutor(10); }));
+
+TEST(ExecutorPolicies, LowLatencyExecutor) {
+    auto pool = MakeThreadPoolExecutor<LowLatencyExecutor>(2);
+    auto dependency = std::make_shared<TestTask>();
+    auto task = std::make_shared<TestTask>();
+    task->AddDependency(dependency);
+
+    pool->Submit(task);
+    pool->Submit(dependency);
+
+    task->Wait();
+    EXPECT_TRUE(task->completed);
+    EXPECT_EQ(pool->Invoke<int>([] { return 42; })->Get(), 42);
+}
+
+TEST(ExecutorPolicies, BatchedTasksAreStolen) {
+    using BatchingExecutor = BasicExecutor<BatchingQueuePolicy<32>, BlockingWaitPolicy,
+                                           DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<BatchingExecutor>(2);
+
+    // Both workers are held until the queue is full, so the one that picks the blocker takes a
+    // batch with it. The blocker only finishes once the other worker stole and ran that batch.
+    std::atomic<bool> start = false;
+    for (int i = 0; i < 2; ++i) {
+        pool->Submit(MakeFunctionTask([&] { start.wait(false); }));
+    }
+    std::atomic<int> done = 0;
+    auto blocker = pool->Invoke<bool>([&] {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (done.load() < 100 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        return done.load() == 100;
+    });
+    for (int i = 0; i < 100; ++i) {
+        pool->Submit(MakeFunctionTask([&] { ++done; }));
+    }
+    start = true;
+    start.notify_all();
+
+    EXPECT_TRUE(blocker->Get());
+}
+
+TEST(ExecutorPolicies, RunNextKeepsFollowUpsOnTheWorker) {
+    using RunNextExecutor = BasicExecutor<RunNextQueuePolicy<>, BlockingWaitPolicy,
+                                          DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<RunNextExecutor>(4);
+
+    std::vector<size_t> workers;
+    std::atomic<bool> done = false;
+    std::function<void()> step = [&] {
+        workers.push_back(CurrentWorkerIndex());
+        if (workers.size() < 100) {
+            pool->Submit(MakeFunctionTask(step));
+        } else {
+            done = true;
+            done.notify_one();
+        }
+    };
+    pool->Submit(MakeFunctionTask(step));
+    done.wait(false);
+
+    ASSERT_EQ(workers.size(), 100u);
+    EXPECT_GE(std::ranges::count(workers, workers[0]), 90);
+}
+
+TEST(ExecutorPolicies, RunNextSlotIsStolenFromBusyWorker) {
+    using RunNextExecutor = BasicExecutor<RunNextQueuePolicy<>, BlockingWaitPolicy,
+                                          DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<RunNextExecutor>(2);
+
+    auto outer = pool->Invoke<bool>([&] {
+        std::atomic<bool> ran = false;
+        auto follow_up = MakeFunctionTask([&] { ran = true; });
+        pool->Submit(follow_up);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!ran && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        follow_up->Wait();
+        return ran.load();
+    });
+    EXPECT_TRUE(outer->Get());
+}
+
+TEST(ExecutorPolicies, DependentsAreParked) {
+    using CountingExecutor =
+        BasicExecutor<FifoQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy, CountingStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<CountingExecutor>(2);
+
+    auto input = pool->Invoke<int>([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return 1;
+    });
+    auto output = pool->Then<int>(input, [input] { return input->Get() + 1; });
+    EXPECT_EQ(output->Get(), 2);
+    // Parked on the input once instead of requeued until it finished.
+    EXPECT_LE(pool->Stats().Get().requeued, 1u);
+}
+
+TEST(ExecutorPolicies, TimeTriggeredTasksWaitOnTimer) {
+    using CountingExecutor =
+        BasicExecutor<FifoQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy, CountingStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<CountingExecutor>(2);
+
+    auto start = std::chrono::system_clock::now();
+    auto task = pool->Invoke<int>([] { return 1; });
+    auto delayed = pool->WhenAllBeforeDeadline(std::vector<FuturePtr<int>>{task},
+                                               start + std::chrono::milliseconds(50));
+    EXPECT_EQ(delayed->Get().size(), 1u);
+    EXPECT_GE(std::chrono::system_clock::now() - start, std::chrono::milliseconds(50));
+    // Handed to the timer once, or twice if the timer fired just before the system clock caught up.
+    EXPECT_LE(pool->Stats().Get().requeued, 2u);
+}
+
+TEST(ExecutorPolicies, ThenChainStaysOnWorker) {
+    using LocalExecutor =
+        BasicExecutor<LocalQueuePolicy<>, BlockingWaitPolicy, DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<LocalExecutor>(4);
+
+    constexpr int kStages = 200;
+    std::vector<size_t> workers(kStages);
+    auto stage = pool->Invoke<Unit>([&] {
+        workers[0] = CurrentWorkerIndex();
+        return Unit{};
+    });
+    for (int i = 1; i < kStages; ++i) {
+        stage = pool->Then<Unit>(stage, [&workers, i] {
+            workers[i] = CurrentWorkerIndex();
+            return Unit{};
+        });
+    }
+    stage->Wait();
+
+    int same_as_input = 0;
+    for (int i = 1; i < kStages; ++i) {
+        same_as_input += workers[i] == workers[i - 1];
+    }
+    EXPECT_GE(same_as_input, kStages / 2);
+}
+
+// Workers that ran the dependents of a single task.
+template <class E>
+std::set<size_t> FanOutWorkers() {
+    auto pool = MakeThreadPoolExecutor<E>(4);
+    // Long enough for the other workers to fall asleep again after it was submitted.
+    auto root =
+        MakeFunctionTask([] { std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+    std::mutex mutex;
+    std::set<size_t> workers;
+    std::vector<std::shared_ptr<Task>> dependents;
+    for (int i = 0; i < 32; ++i) {
+        dependents.push_back(MakeFunctionTask([&] {
+            auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+            while (std::chrono::steady_clock::now() < until) {
+            }
+            std::lock_guard guard(mutex);
+            workers.insert(CurrentWorkerIndex());
+        }));
+        dependents.back()->AddDependency(root);
+        pool->Submit(dependents.back());
+    }
+    // All of them are parked on the root, so they are queued by the worker that runs it.
+    while (pool->Stats().Get().requeued < dependents.size()) {
+        std::this_thread::yield();
+    }
+    pool->Submit(root);
+    for (auto& task : dependents) {
+        task->Wait();
+    }
+    return workers;
+}
+
+TEST(ExecutorPolicies, FanOutWakesOtherWorkers) {
+    using LocalExecutor = BasicExecutor<LocalQueuePolicy<>, BlockingWaitPolicy,
+                                        DefaultAllocPolicy, CountingStatsPolicy>;
+    using DistributedExecutor = BasicExecutor<DistributedQueuePolicy<>, BlockingWaitPolicy,
+                                              DefaultAllocPolicy, CountingStatsPolicy>;
+    EXPECT_GT(FanOutWorkers<LocalExecutor>().size(), 1u);
+    EXPECT_GT(FanOutWorkers<DistributedExecutor>().size(), 1u);
+}
+
+TEST(ExecutorPolicies, AffinityHint) {
+    using LocalExecutor =
+        BasicExecutor<LocalQueuePolicy<>, BlockingWaitPolicy, DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<LocalExecutor>(2);
+
+    auto task = pool->Invoke<size_t>([] { return CurrentWorkerIndex(); });
+    EXPECT_LT(task->Get(), 2u);
+    auto hinted = std::make_shared<Future<size_t>>([] { return CurrentWorkerIndex(); });
+    EXPECT_EQ(hinted->Affinity(), kNoWorker);
+    hinted->SetAffinity(1);
+    EXPECT_EQ(hinted->Affinity(), 1u);
+    pool->Submit(hinted);
+    EXPECT_LT(hinted->Get(), 2u);
+}
+
+TEST(ExecutorPolicies, TwoChoicesPicksShorterQueue) {
+    std::vector<CacheLinePadded<std::atomic<size_t>>> lengths(4);
+    for (size_t i = 0; i < 3; ++i) {
+        lengths[i].value = 100;
+    }
+    TwoChoicesPlacement two_choices;
+    RoundRobinPlacement round_robin;
+    size_t picked_empty = 0;
+    for (size_t i = 0; i < 1000; ++i) {
+        picked_empty += two_choices.Pick(lengths) == 3;
+        EXPECT_EQ(round_robin.Pick(lengths), i % 4);
+    }
+    // Random placement would pick the empty queue a quarter of the time, two choices 7/16.
+    EXPECT_GT(picked_empty, 350u);
+}
+
+TEST(ExecutorPolicies, DistributedQueues) {
+    using DistributedExecutor = BasicExecutor<DistributedQueuePolicy<>, BlockingWaitPolicy,
+                                              DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<DistributedExecutor>(3);
+
+    std::atomic<size_t> done = 0;
+    std::vector<FuturePtr<int>> tasks;
+    for (size_t i = 0; i < 300; ++i) {
+        tasks.push_back(pool->Invoke<int>([&] {
+            pool->Invoke<int>([&] { return static_cast<int>(++done); });
+            return 0;
+        }));
+    }
+    for (auto& task : tasks) {
+        task->Get();
+    }
+    pool->StartShutdown();
+    pool->WaitShutdown();
+    EXPECT_EQ(done.load(), 300u);
+}
+
+TEST(ExecutorPolicies, PriorityOrder) {
+    using PriorityExecutor = BasicExecutor<PriorityQueuePolicy, BlockingWaitPolicy,
+                                           DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<PriorityExecutor>(1);
+
+    std::atomic<bool> release = false;
+    pool->Submit(MakeFunctionTask([&] { release.wait(false); }));
+    std::vector<int> order;
+    std::vector<std::shared_ptr<Task>> tasks;
+    for (int priority : {0, 5, -3, 5, 1000}) {
+        auto task = MakeFunctionTask([&order, priority] { order.push_back(priority); });
+        task->SetPriority(priority);
+        pool->Submit(task);
+        tasks.push_back(task);
+    }
+    release = true;
+    release.notify_one();
+    for (auto& task : tasks) {
+        task->Wait();
+    }
+    EXPECT_EQ(order, (std::vector<int>{1000, 5, 5, 0, -3}));
+    EXPECT_EQ(tasks.back()->Priority(), Task::kMaxPriority);
+}
+
+TEST(ExecutorPolicies, PriorityInheritance) {
+    using PriorityExecutor = BasicExecutor<PriorityQueuePolicy, BlockingWaitPolicy,
+                                           DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<PriorityExecutor>(1);
+
+    std::atomic<bool> release = false;
+    pool->Submit(MakeFunctionTask([&] { release.wait(false); }));
+    std::vector<std::string> order;
+    std::vector<std::shared_ptr<Task>> bulk;
+    for (int i = 0; i < 5; ++i) {
+        bulk.push_back(MakeFunctionTask([&order] { order.push_back("bulk"); }));
+        pool->Submit(bulk.back());
+    }
+    // Queued behind the bulk tasks and unknown to the root until the end.
+    auto input = MakeFunctionTask([&order] { order.push_back("input"); });
+    auto input_of_input = MakeFunctionTask([&order] { order.push_back("input of input"); });
+    input->AddDependency(input_of_input);
+    pool->Submit(input);
+    pool->Submit(input_of_input);
+    auto root = MakeFunctionTask([&order] { order.push_back("root"); });
+    root->SetPriority(10);
+    root->AddDependency(input);
+    EXPECT_EQ(input_of_input->Priority(), 0);
+    pool->Submit(root);
+    EXPECT_EQ(input_of_input->Priority(), 10);
+
+    release = true;
+    release.notify_one();
+    for (auto& task : bulk) {
+        task->Wait();
+    }
+    root->Wait();
+    ASSERT_EQ(order.size(), 8u);
+    EXPECT_EQ(std::vector(order.begin(), order.begin() + 3),
+              (std::vector<std::string>{"input of input", "input", "root"}));
+    EXPECT_EQ(input->Priority(), 0);
+    EXPECT_EQ(root->Priority(), 10);
+}
+
+TEST(ExecutorPolicies, CriticalPathRunsFirst) {
+    using PriorityExecutor = BasicExecutor<PriorityQueuePolicy, BlockingWaitPolicy,
+                                           DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<PriorityExecutor>(1);
+
+    std::atomic<bool> release = false;
+    pool->Submit(MakeFunctionTask([&] { release.wait(false); }));
+    std::vector<std::string> order;
+    std::vector<std::shared_ptr<Task>> graph;
+    std::vector<double> costs;
+    for (int i = 0; i < 5; ++i) {
+        graph.push_back(MakeFunctionTask([&order] { order.push_back("short"); }));
+        costs.push_back(0.5);
+    }
+    for (std::string name : {"chain 1", "chain 2", "chain 3"}) {
+        graph.push_back(MakeFunctionTask([&order, name] { order.push_back(name); }));
+        if (costs.size() > 5) {
+            graph.back()->AddDependency(graph[graph.size() - 2]);
+        }
+        costs.push_back(1);
+    }
+    ASSERT_TRUE(pool->SubmitGraph(graph, costs));
+    EXPECT_EQ(graph[5]->Priority(), Task::kMaxPriority);
+    EXPECT_EQ(graph[7]->Priority(), Task::kMaxPriority / 3);
+    EXPECT_LT(graph[0]->Priority(), graph[7]->Priority());
+
+    release = true;
+    release.notify_one();
+    for (auto& task : graph) {
+        task->Wait();
+    }
+    ASSERT_EQ(order.size(), 8u);
+    EXPECT_EQ(std::vector(order.begin(), order.begin() + 3),
+              (std::vector<std::string>{"chain 1", "chain 2", "chain 3"}));
+}
+
+TEST(ExecutorPolicies, SubmitGraphRejectsBadCosts) {
+    using PriorityExecutor = BasicExecutor<PriorityQueuePolicy, BlockingWaitPolicy,
+                                           DefaultAllocPolicy, NoStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<PriorityExecutor>(1);
+
+    std::vector<std::shared_ptr<Task>> tasks;
+    for (int i = 0; i < 2; ++i) {
+        tasks.push_back(MakeFunctionTask([] {}));
+    }
+    tasks[1]->AddDependency(tasks[0]);
+    EXPECT_THROW(pool->SubmitGraph(tasks, {1.0}), std::invalid_argument);
+    EXPECT_THROW(pool->SubmitGraph(tasks, {1.0, -1.0}), std::invalid_argument);
+    EXPECT_TRUE(pool->SubmitGraph(tasks, {1.0, 2.0}));
+    tasks[1]->Wait();
+}
+
+TEST(ExecutorPolicies, CountingStats) {
+    using CountingExecutor =
+        BasicExecutor<FifoQueuePolicy, BlockingWaitPolicy, DefaultAllocPolicy, CountingStatsPolicy>;
+    auto pool = MakeThreadPoolExecutor<CountingExecutor>(2);
+
+    auto task = std::make_shared<TestTask>();
+    auto failing = std::make_shared<FailingTestTask>();
+    pool->Submit(task);
+    pool->Submit(failing);
+    task->Wait();
+    failing->Wait();
+
+    auto counters = pool->Stats().Get();
+    EXPECT_EQ(counters.submitted, 2u);
+    EXPECT_EQ(counters.run, 2u);
+    EXPECT_EQ(counters.failed, 1u);
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fiber_executor.h>
+
+struct FiberExecutorTest : public ::testing::Test {
+    std::shared_ptr<FiberExecutor> pool;
+
+    FiberExecutorTest() {
+        pool = MakeThreadPoolExecutor<FiberExecutor>(2);
+    }
+};
+
+TEST_F(FiberExecutorTest, RunsTasks) {
+    std::vector<FuturePtr<int>> results;
+    for (int i = 0; i < 1000; ++i) {
+        results.push_back(pool->Invoke<int>([i] { return i * i; }));
+    }
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(results[i]->Get(), i * i);
+    }
+}
+
+TEST_F(FiberExecutorTest, MoreBlockedTasksThanWorkers) {
+    // On a thread pool the first two waiters would block both workers and the gate queued behind
+    // them would never run.
+    auto gate = MakeFunctionTask([] {});
+    std::atomic<int> woken = 0;
+    std::vector<std::shared_ptr<Task>> waiters;
+    for (int i = 0; i < 100; ++i) {
+        auto waiter = MakeFunctionTask([&] {
+            gate->Wait();
+            EXPECT_TRUE(gate->IsCompleted());
+            ++woken;
+        });
+        waiters.push_back(waiter);
+        ASSERT_TRUE(pool->Submit(waiter));
+    }
+    ASSERT_TRUE(pool->Submit(gate));
+
+    for (auto& waiter : waiters) {
+        waiter->Wait();
+        EXPECT_TRUE(waiter->IsCompleted());
+    }
+    EXPECT_EQ(woken.load(), 100);
+}
+
+TEST_F(FiberExecutorTest, RecursiveGet) {
+    std::function<int(int)> fib = [&](int n) {
+        if (n < 2) {
+            return n;
+        }
+        auto a = pool->Invoke<int>([&, n] { return fib(n - 1); });
+        auto b = pool->Invoke<int>([&, n] { return fib(n - 2); });
+        return a->Get() + b->Get();
+    };
+    EXPECT_EQ(pool->Invoke<int>([&] { return fib(15); })->Get(), 610);
+}
+
+TEST_F(FiberExecutorTest, ErrorsAfterResume) {
+    auto slow = pool->Invoke<int>([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        throw std::runtime_error("slow");
+        return 0;
+    });
+    auto reader = pool->Invoke<int>([&] { return slow->Get() + 1; });
+
+    EXPECT_THROW(reader->Get(), std::runtime_error);
+    EXPECT_TRUE(reader->IsFailed());
+}
+
+TEST_F(FiberExecutorTest, ResumesAfterShutdown) {
+    auto gate = MakeFunctionTask([] {});
+    auto waiter = MakeFunctionTask([&] { gate->Wait(); });
+    ASSERT_TRUE(pool->Submit(waiter));
+    pool->StartShutdown();
+    pool->WaitShutdown();
+    EXPECT_FALSE(waiter->IsFinished());
+
+    // The executor takes no tasks anymore, so the waiter resumes on the thread finishing the gate.
+    gate->Cancel();
+    EXPECT_TRUE(waiter->IsCompleted());
+}
+
+TEST_F(FiberExecutorTest, DestroyedWhileSuspended) {
+    auto gate = MakeFunctionTask([] {});
+    std::atomic<bool> started = false;
+    std::atomic<bool> resumed = false;
+    auto waiter = MakeFunctionTask([gate, &started, &resumed] {
+        started = true;
+        started.notify_one();
+        gate->Wait();
+        resumed = true;
+    });
+    ASSERT_TRUE(pool->Submit(waiter));
+    started.wait(false);
+    std::jthread opener([gate] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        gate->Cancel();
+    });
+
+    // Waits for the suspended waiter, which resumes on the opener thread.
+    pool.reset();
+    EXPECT_TRUE(resumed);
+    EXPECT_TRUE(waiter->IsCompleted());
+}
@@ -66,6 +66,28 @@ TEST_F(FutureTest, ThenIsNonBlocking) {
     EXPECT_LE(std::chrono::duration_cast<std::chrono::milliseconds>(delta).count(), 50);
 }
 
+TEST_F(FutureTest, ThenReleasesPredecessors) {
+    auto first = pool->Invoke<int>([] { return 0; });
+    auto future = pool->Then<int>(first, [first] { return first->Get() + 1; });
+    for (int i = 1; i < 100'000; ++i) {
+        future = pool->Then<int>(future, [future] { return future->Get() + 1; });
+        if (i % 1000 == 0) {
+            future->Wait();
+        }
+    }
+
+    EXPECT_EQ(future->Get(), 100'000);
+    EXPECT_EQ(first.use_count(), 1);
+}
+
+TEST_F(FutureTest, FailedThenReleasesPredecessor) {
+    auto first = pool->Invoke<int>([] { return 0; });
+    auto future = pool->Then<int>(first, [first]() -> int { throw std::logic_error("Test"); });
+
+    EXPECT_THROW(future->Get(), std::logic_error);
+    EXPECT_EQ(first.use_count(), 1);
+}
+
 TEST_F(FutureTest, WhenAll) {
     const size_t n = 100;
     std::atomic<size_t> count{0};
@@ -132,3 +154,338 @@ TEST_F(FutureTest, WhenAllBeforeDeadline) {
     ASSERT_EQ(result.size(), n);
     ASSERT_LE(time.count(), 80);
 }
+
+TEST_F(FutureTest, WhenEach) {
+    std::vector<FuturePtr<int>> all;
+    for (int i = 0; i < 3; i++) {
+        all.push_back(pool->Invoke<int>([i] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(60 - 30 * i));
+            return i;
+        }));
+    }
+    all.push_back(pool->Invoke<int>([]() -> int { throw std::logic_error("Test"); }));
+
+    auto stream = pool->WhenEach(all);
+    std::vector<int> results;
+    size_t failed = 0;
+    while (auto future = stream->Take()) {
+        if (future->IsFailed()) {
+            failed++;
+        } else {
+            results.push_back(future->Get());
+        }
+    }
+
+    ASSERT_EQ(failed, 1u);
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_EQ(results.back(), 0);
+}
+
+TEST_F(FutureTest, WhenEachDoesNotWaitForSlowest) {
+    auto start = std::chrono::system_clock::now();
+    auto slow = pool->Invoke<int>([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        return 1;
+    });
+    auto fast = pool->Invoke<int>([] { return 2; });
+
+    auto stream = pool->WhenEach(std::vector<FuturePtr<int>>{slow, fast});
+    auto first = stream->Take();
+    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now() - start);
+
+    ASSERT_EQ(first->Get(), 2);
+    ASSERT_LE(time.count(), 50);
+    ASSERT_EQ(stream->Take()->Get(), 1);
+    ASSERT_EQ(stream->Take(), nullptr);
+}
+
+TEST_F(FutureTest, WhenEachEmpty) {
+    auto stream = pool->WhenEach(std::vector<FuturePtr<int>>{});
+    ASSERT_EQ(stream->Take(), nullptr);
+}
+
+static std::vector<FuturePtr<int>> MakePromises(size_t n) {
+    std::vector<FuturePtr<int>> all;
+    for (size_t i = 0; i < n; i++) {
+        all.push_back(std::make_shared<Future<int>>());
+    }
+    return all;
+}
+
+TEST_F(FutureTest, WhenNCompletesEarly) {
+    auto all = MakePromises(5);
+    auto res_future = pool->WhenN(all, 3);
+
+    all[4]->SetValue(4);
+    all[0]->SetError(std::make_exception_ptr(std::logic_error("Test")));
+    all[2]->SetValue(2);
+    EXPECT_FALSE(res_future->IsFinished());
+
+    all[1]->SetValue(1);
+    ASSERT_TRUE(res_future->IsCompleted());
+    EXPECT_EQ(res_future->Get(), (std::vector<int>{1, 2, 4}));
+
+    all[3]->SetValue(3);
+    EXPECT_EQ(res_future->Get().size(), 3u);
+}
+
+TEST_F(FutureTest, WhenNFailsWhenQuorumIsImpossible) {
+    auto all = MakePromises(5);
+    auto res_future = pool->WhenN(all, 3);
+
+    all[0]->SetValue(0);
+    all[1]->SetError(std::make_exception_ptr(std::logic_error("Test")));
+    all[2]->Cancel();
+    EXPECT_FALSE(res_future->IsFinished());
+
+    all[3]->SetError(std::make_exception_ptr(std::out_of_range("Test")));
+    ASSERT_TRUE(res_future->IsFailed());
+    EXPECT_THROW(res_future->Get(), std::out_of_range);
+
+    all[4]->SetValue(4);
+    EXPECT_TRUE(res_future->IsFailed());
+}
+
+TEST_F(FutureTest, WhenNCancelsStragglers) {
+    auto all = MakePromises(5);
+    auto res_future = pool->WhenN(all, 2, true);
+
+    all[0]->SetValue(0);
+    all[1]->SetValue(1);
+    ASSERT_TRUE(res_future->IsCompleted());
+    for (size_t i = 2; i < all.size(); i++) {
+        EXPECT_TRUE(all[i]->IsCanceled());
+    }
+}
+
+TEST_F(FutureTest, WhenNWithFinishedInputs) {
+    auto all = MakePromises(3);
+    for (size_t i = 0; i < all.size(); i++) {
+        all[i]->SetValue(i);
+    }
+    EXPECT_EQ(pool->WhenMajority(all)->Get(), (std::vector<int>{0, 1}));
+    EXPECT_TRUE(pool->WhenN(all, 0)->Get().empty());
+    EXPECT_THROW(pool->WhenN(all, 4), std::invalid_argument);
+}
+
+TEST_F(FutureTest, WhenNOnPool) {
+    std::vector<FuturePtr<int>> all;
+    for (int i = 0; i < 10; i++) {
+        all.push_back(pool->Invoke<int>([i] {
+            if (i % 2) {
+                throw std::logic_error("Test");
+            }
+            return i;
+        }));
+    }
+    EXPECT_EQ(pool->WhenN(all, 5)->Get().size(), 5u);
+    EXPECT_THROW(pool->WhenN(all, 6)->Get(), std::logic_error);
+}
+
+TEST_F(FutureTest, WhenAllDoesNotBlockWorker) {
+    auto single = MakeThreadPoolExecutor(1);
+    auto input = std::make_shared<Future<int>>();
+    auto res_future = single->WhenAll(std::vector<FuturePtr<int>>{input});
+
+    auto other = single->Invoke<int>([] { return 1; });
+    ASSERT_EQ(other->Get(), 1);
+    EXPECT_FALSE(res_future->IsFinished());
+
+    input->SetValue(2);
+    EXPECT_EQ(res_future->Get(), std::vector<int>{2});
+}
+
+TEST_F(FutureTest, WhenAllRethrowsFirstErrorInOrder) {
+    auto all = MakePromises(3);
+    auto res_future = pool->WhenAll(all);
+
+    all[2]->SetError(std::make_exception_ptr(std::out_of_range("Test")));
+    all[1]->SetError(std::make_exception_ptr(std::logic_error("Test")));
+    EXPECT_FALSE(res_future->IsFinished());
+
+    all[0]->SetValue(0);
+    EXPECT_THROW(res_future->Get(), std::logic_error);
+}
+
+TEST_F(FutureTest, WhenAllFailFast) {
+    auto all = MakePromises(3);
+    auto res_future = pool->WhenAll(all, WhenAllMode::kFailFast);
+
+    all[0]->SetValue(0);
+    all[1]->SetError(std::make_exception_ptr(std::logic_error("Test")));
+
+    ASSERT_TRUE(res_future->IsFailed());
+    EXPECT_THROW(res_future->Get(), std::logic_error);
+    EXPECT_TRUE(all[2]->IsCanceled());
+}
+
+TEST_F(FutureTest, WhenAllFailFastSucceeds) {
+    auto all = MakePromises(3);
+    auto res_future = pool->WhenAll(all, WhenAllMode::kFailFast);
+    for (size_t i = 0; i < all.size(); i++) {
+        all[i]->SetValue(i);
+    }
+    EXPECT_EQ(res_future->Get(), (std::vector<int>{0, 1, 2}));
+}
+
+TEST_F(FutureTest, WhenAllCollectErrors) {
+    auto all = MakePromises(4);
+    auto res_future = pool->WhenAll(all, WhenAllMode::kCollectErrors);
+
+    all[3]->SetError(std::make_exception_ptr(std::out_of_range("Test")));
+    all[0]->SetValue(0);
+    all[1]->SetError(std::make_exception_ptr(std::logic_error("Test")));
+    EXPECT_FALSE(res_future->IsFinished());
+    all[2]->SetValue(2);
+
+    try {
+        res_future->Get();
+        FAIL() << "Expected AggregateError";
+    } catch (const AggregateError& error) {
+        ASSERT_EQ(error.Errors().size(), 2u);
+        EXPECT_THROW(std::rethrow_exception(error.Errors()[0]), std::logic_error);
+        EXPECT_THROW(std::rethrow_exception(error.Errors()[1]), std::out_of_range);
+    }
+}
+
+TEST_F(FutureTest, WhenAllTuple) {
+    auto number = pool->Invoke<int>([] { return 42; });
+    auto text = pool->Invoke<std::string>([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return std::string("Hello World");
+    });
+    auto flag = std::make_shared<Future<bool>>();
+
+    auto res_future = pool->WhenAll(number, text, flag);
+    text->Wait();
+    EXPECT_FALSE(res_future->IsFinished());
+
+    flag->SetValue(true);
+    auto [x, s, b] = res_future->Get();
+    EXPECT_EQ(x, 42);
+    EXPECT_EQ(s, "Hello World");
+    EXPECT_TRUE(b);
+}
+
+TEST_F(FutureTest, WhenAllTupleException) {
+    auto number = pool->Invoke<int>([] { return 42; });
+    auto failed =
+        pool->Invoke<std::string>([]() -> std::string { throw std::logic_error("Test"); });
+
+    ASSERT_THROW(pool->WhenAll(number, failed)->Get(), std::logic_error);
+}
+
+TEST_F(FutureTest, WhenAllTupleFailsFast) {
+    auto number = std::make_shared<Future<int>>();
+    auto text = std::make_shared<Future<std::string>>();
+    auto flag = std::make_shared<Future<bool>>();
+    auto res_future = pool->WhenAll(number, text, flag);
+
+    number->SetValue(42);
+    text->SetError(std::make_exception_ptr(std::logic_error("Test")));
+
+    ASSERT_TRUE(res_future->IsFailed());
+    EXPECT_THROW(res_future->Get(), std::logic_error);
+    EXPECT_FALSE(flag->IsFinished());
+    flag->SetValue(true);
+}
+
+TEST_F(FutureTest, WhenAllTupleCanceledInputFails) {
+    auto number = std::make_shared<Future<int>>();
+    auto text = std::make_shared<Future<std::string>>();
+    auto res_future = pool->WhenAll(number, text);
+
+    number->SetValue(42);
+    text->Cancel();
+
+    ASSERT_TRUE(res_future->IsFailed());
+    EXPECT_THROW(res_future->Get(), std::runtime_error);
+}
+
+TEST_F(FutureTest, HedgeLaunchesBackup) {
+    std::atomic<int> copies{0};
+    std::atomic<bool> loser_stopped{false};
+    auto start = std::chrono::system_clock::now();
+
+    auto res_future = pool->Hedge<int>(
+        [&](std::stop_token token) {
+            int id = copies++;
+            if (id == 0) {
+                while (!token.stop_requested()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                loser_stopped = true;
+            }
+            return id;
+        },
+        std::chrono::milliseconds(10), 3);
+
+    ASSERT_EQ(res_future->Get(), 1);
+    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now() - start);
+    EXPECT_LE(time.count(), 50);
+
+    while (!loser_stopped) {
+        std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_EQ(copies, 2);
+}
+
+TEST_F(FutureTest, HedgeFastCallRunsOnce) {
+    std::atomic<int> copies{0};
+    auto res_future = pool->Hedge<int>([&](std::stop_token) { return copies++; },
+                                       std::chrono::milliseconds(20), 3);
+    ASSERT_EQ(res_future->Get(), 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    EXPECT_EQ(copies, 1);
+}
+
+TEST_F(FutureTest, HedgeFailedCopyLaunchesNextAtOnce) {
+    std::atomic<int> copies{0};
+    auto start = std::chrono::steady_clock::now();
+    auto res_future = pool->Hedge<int>(
+        [&](std::stop_token) {
+            int id = copies++;
+            if (id == 0) {
+                throw std::logic_error("Test");
+            }
+            return id;
+        },
+        std::chrono::seconds(10), 3);
+
+    ASSERT_EQ(res_future->Get(), 1);
+    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    EXPECT_LE(time.count(), 1000);
+    EXPECT_EQ(copies, 2);
+}
+
+TEST_F(FutureTest, HedgePendingBackupsCanceledOnShutdown) {
+    std::atomic<int> copies{0};
+    auto res_future = pool->Hedge<int>(
+        [&](std::stop_token) -> int {
+            copies++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            throw std::logic_error("Test");
+        },
+        std::chrono::hours(1), 3);
+    pool.reset();
+
+    ASSERT_TRUE(res_future->IsFinished());
+    EXPECT_THROW(res_future->Get(), std::logic_error);
+    EXPECT_EQ(copies, 1);
+}
+
+TEST_F(FutureTest, HedgeFailsWhenAllCopiesFail) {
+    std::atomic<int> copies{0};
+    auto res_future = pool->Hedge<int>(
+        [&](std::stop_token) -> int {
+            copies++;
+            throw std::logic_error("Test");
+        },
+        std::chrono::milliseconds(1), 3);
+    ASSERT_THROW(res_future->Get(), std::logic_error);
+    EXPECT_EQ(copies, 3);
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <invoke_cache.h>
+
+struct InvokeCacheTest : public ::testing::Test {
+    std::shared_ptr<Executor> pool;
+
+    InvokeCacheTest() {
+        pool = MakeThreadPoolExecutor(2);
+    }
+};
+
+TEST_F(InvokeCacheTest, HitReturnsCompletedFuture) {
+    InvokeCache<int, int> cache(pool, 16, std::chrono::seconds(10));
+    std::atomic<int> computations{0};
+    auto compute = [&] { return ++computations; };
+
+    auto first = cache.Invoke(1, compute);
+    EXPECT_EQ(first->Get(), 1);
+
+    auto second = cache.Invoke(1, compute);
+    EXPECT_EQ(first, second);
+    EXPECT_TRUE(second->IsCompleted());
+    EXPECT_EQ(computations, 1);
+
+    auto stats = cache.GetStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 1u);
+}
+
+TEST_F(InvokeCacheTest, InFlightCallsCollapse) {
+    InvokeCache<int, int> cache(pool, 16, std::chrono::seconds(10));
+    std::atomic<int> computations{0};
+    auto compute = [&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return ++computations;
+    };
+
+    auto first = cache.Invoke(1, compute);
+    auto second = cache.Invoke(1, compute);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(second->Get(), 1);
+}
+
+TEST_F(InvokeCacheTest, TtlExpires) {
+    InvokeCache<int, int> cache(pool, 16, std::chrono::milliseconds(20));
+    std::atomic<int> computations{0};
+    auto compute = [&] { return ++computations; };
+
+    EXPECT_EQ(cache.Invoke(1, compute)->Get(), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_EQ(cache.Invoke(1, compute)->Get(), 2);
+}
+
+TEST_F(InvokeCacheTest, ClockKeepsReferencedEntries) {
+    InvokeCache<int, int> cache(pool, 2, std::chrono::seconds(10), 1);
+    auto compute = [] { return 0; };
+
+    auto a = cache.Invoke(1, compute);
+    cache.Invoke(2, compute);
+    EXPECT_EQ(cache.Invoke(1, compute), a);
+
+    // 2 is not referenced, so it is the victim.
+    cache.Invoke(3, compute);
+    EXPECT_EQ(cache.Size(), 2u);
+    EXPECT_EQ(cache.Invoke(1, compute), a);
+    EXPECT_EQ(cache.GetStats().misses, 3u);
+
+    cache.Invoke(2, compute);
+    EXPECT_EQ(cache.GetStats().misses, 4u);
+    EXPECT_EQ(cache.Size(), 2u);
+}
+
+TEST_F(InvokeCacheTest, FailuresAreNotCached) {
+    InvokeCache<int, int> cache(pool, 16, std::chrono::seconds(10));
+
+    auto failed = cache.Invoke(1, []() -> int { throw std::logic_error("Test"); });
+    EXPECT_THROW(failed->Get(), std::logic_error);
+    while (cache.Size() > 0) {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(cache.Invoke(1, [] { return 1; })->Get(), 1);
+}
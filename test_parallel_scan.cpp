@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <parallel_scan.h>
+
+struct ParallelScanTest : public ::testing::Test {
+    std::shared_ptr<Executor> pool;
+
+    ParallelScanTest() {
+        pool = MakeThreadPoolExecutor(4);
+    }
+};
+
+static std::vector<int64_t> RandomInput(size_t n) {
+    std::mt19937 gen(n);
+    std::vector<int64_t> data(n);
+    for (auto& x : data) {
+        x = static_cast<int64_t>(gen() % 1000) - 500;
+    }
+    return data;
+}
+
+TEST_F(ParallelScanTest, InclusiveScan) {
+    for (size_t n : {0, 1, 1000, 1 << 16, (1 << 20) + 17}) {
+        auto data = RandomInput(n);
+        std::vector<int64_t> expected(n), result(n);
+        std::inclusive_scan(data.begin(), data.end(), expected.begin());
+
+        auto end = ParallelInclusiveScan(*pool, data.begin(), data.end(), result.begin());
+        EXPECT_EQ(end, result.end());
+        EXPECT_EQ(result, expected) << "n = " << n;
+    }
+}
+
+TEST_F(ParallelScanTest, ExclusiveScan) {
+    for (size_t n : {0, 1, 1000, 1 << 16, (1 << 20) + 17}) {
+        auto data = RandomInput(n);
+        std::vector<int64_t> expected(n), result(n);
+        std::exclusive_scan(data.begin(), data.end(), expected.begin(), int64_t{7});
+
+        auto end =
+            ParallelExclusiveScan(*pool, data.begin(), data.end(), result.begin(), int64_t{7});
+        EXPECT_EQ(end, result.end());
+        EXPECT_EQ(result, expected) << "n = " << n;
+    }
+}
+
+TEST_F(ParallelScanTest, InPlaceScanWithCustomOp) {
+    auto data = RandomInput(1 << 20);
+    auto expected = data;
+    auto max = [](int64_t a, int64_t b) { return std::max(a, b); };
+    std::inclusive_scan(expected.begin(), expected.end(), expected.begin(), max);
+
+    ParallelInclusiveScan(*pool, data.begin(), data.end(), data.begin(), max);
+    EXPECT_EQ(data, expected);
+
+    data = RandomInput(1 << 20);
+    expected = data;
+    std::exclusive_scan(expected.begin(), expected.end(), expected.begin(), int64_t{0});
+    ParallelExclusiveScan(*pool, data.begin(), data.end(), data.begin(), int64_t{0});
+    EXPECT_EQ(data, expected);
+}
+
+TEST_F(ParallelScanTest, CopyIf) {
+    for (size_t n : {0, 1000, (1 << 20) + 17}) {
+        auto data = RandomInput(n);
+        auto is_even = [](int64_t x) { return x % 2 == 0; };
+
+        std::vector<int64_t> expected, result(n);
+        std::copy_if(data.begin(), data.end(), std::back_inserter(expected), is_even);
+
+        auto end = ParallelCopyIf(*pool, data.begin(), data.end(), result.begin(), is_even);
+        result.erase(end, result.end());
+        EXPECT_EQ(result, expected) << "n = " << n;
+    }
+}
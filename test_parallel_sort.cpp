@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <parallel_sort.h>
+
+struct ParallelSortTest : public ::testing::Test {
+    std::shared_ptr<Executor> pool;
+
+    ParallelSortTest() {
+        pool = MakeThreadPoolExecutor(4);
+    }
+};
+
+TEST_F(ParallelSortTest, SmallInputFallsBackToStdSort) {
+    std::vector<int> data{5, 3, 1, 4, 2};
+    ParallelSort(*pool, data.begin(), data.end());
+    EXPECT_EQ(data, (std::vector<int>{1, 2, 3, 4, 5}));
+}
+
+TEST_F(ParallelSortTest, RandomInts) {
+    std::mt19937 gen(42);
+    std::vector<int> data(1 << 20);
+    for (auto& x : data) {
+        x = gen();
+    }
+
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+
+    ParallelSort(*pool, data.begin(), data.end());
+    EXPECT_EQ(data, expected);
+}
+
+TEST_F(ParallelSortTest, ManyDuplicates) {
+    std::mt19937 gen(7);
+    std::vector<int> data(1 << 19);
+    for (auto& x : data) {
+        x = gen() % 3;
+    }
+
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+
+    ParallelSort(*pool, data.begin(), data.end());
+    EXPECT_EQ(data, expected);
+}
+
+TEST_F(ParallelSortTest, FrequentKeysAmongUniqueOnes) {
+    // Half of the keys are one of four values, which go into equality buckets. Elements are only
+    // compared by key, so equal keys still tell apart by their payload.
+    std::mt19937 gen(11);
+    std::vector<std::pair<int, int>> data(1 << 20);
+    for (size_t i = 0; i < data.size(); ++i) {
+        int key = gen() % 2 ? static_cast<int>(gen() % 4) * 1000 : static_cast<int>(gen());
+        data[i] = {key, static_cast<int>(i)};
+    }
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+
+    ParallelSort(*pool, data.begin(), data.end(),
+                 [](const auto& a, const auto& b) { return a.first < b.first; });
+    EXPECT_TRUE(std::is_sorted(data.begin(), data.end(),
+                               [](const auto& a, const auto& b) { return a.first < b.first; }));
+    std::sort(data.begin(), data.end());
+    EXPECT_EQ(data, expected);
+}
+
+TEST_F(ParallelSortTest, PresortedAndReversed) {
+    std::vector<int> data(1 << 18);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<int>(data.size() - i);
+    }
+
+    ParallelSort(*pool, data.begin(), data.end());
+    EXPECT_TRUE(std::is_sorted(data.begin(), data.end()));
+
+    ParallelSort(*pool, data.begin(), data.end());
+    EXPECT_TRUE(std::is_sorted(data.begin(), data.end()));
+}
+
+TEST_F(ParallelSortTest, CustomComparatorOnStrings) {
+    std::mt19937 gen(1);
+    std::vector<std::string> data(100000);
+    for (auto& s : data) {
+        s = std::to_string(gen());
+    }
+
+    auto expected = data;
+    std::sort(expected.begin(), expected.end(), std::greater<>{});
+
+    ParallelSort(*pool, data.begin(), data.end(), std::greater<>{});
+    EXPECT_EQ(data, expected);
+}
+
+TEST_F(ParallelSortTest, ComparatorExceptionIsPropagated) {
+    std::vector<int> data(1 << 16);
+    std::iota(data.begin(), data.end(), 0);
+    std::shuffle(data.begin(), data.end(), std::mt19937(3));
+
+    auto throwing = [](int a, int b) {
+        if (a == 12345 || b == 12345) {
+            throw std::logic_error("bad key");
+        }
+        return a < b;
+    };
+    EXPECT_THROW(ParallelSort(*pool, data.begin(), data.end(), throwing), std::logic_error);
+}
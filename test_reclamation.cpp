@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <executors.h>
+#include <lock_free_stack.h>
+#include <reclamation.h>
+
+struct Tracked {
+    static inline std::atomic<int> live{0};
+
+    explicit Tracked(int value) : value(value) {
+        ++live;
+    }
+
+    Tracked(Tracked&& other) : value(other.value) {
+        ++live;
+    }
+
+    ~Tracked() {
+        --live;
+    }
+
+    int value;
+};
+
+// Domains must outlive the threads that used them, so tests with their own domain use it from a
+// separate thread only.
+template <class F>
+void RunInThread(F fn) {
+    std::thread(fn).join();
+}
+
+TEST(Reclamation, HazardPointerDelaysDeletion) {
+    EpochDomain domain;
+    RunInThread([&] {
+        std::atomic<Tracked*> source = new Tracked(1);
+        HazardPointer hazard(domain);
+        Tracked* object = hazard.Protect(source);
+        source = nullptr;
+
+        domain.Retire(object);
+        EXPECT_EQ(domain.Collect(), 0u);
+        EXPECT_EQ(object->value, 1);
+
+        hazard.Reset();
+        EXPECT_EQ(domain.Collect(), 1u);
+    });
+    EXPECT_EQ(Tracked::live, 0);
+}
+
+TEST(Reclamation, OnlineThreadDelaysDeletion) {
+    EpochDomain domain;
+    std::atomic<int> step{0};
+    std::thread worker([&] {
+        domain.ThisThread().Online();
+        step = 1;
+        while (step != 2) {
+            std::this_thread::yield();
+        }
+        domain.ThisThread().Quiescent();
+        step = 3;
+        while (step != 4) {
+            std::this_thread::yield();
+        }
+    });
+
+    RunInThread([&] {
+        while (step != 1) {
+            std::this_thread::yield();
+        }
+        domain.Retire(new Tracked(1));
+        EXPECT_EQ(domain.Collect(), 0u);
+
+        step = 2;
+        while (step != 3) {
+            std::this_thread::yield();
+        }
+        EXPECT_EQ(domain.Collect(), 1u);
+        step = 4;
+    });
+    worker.join();
+    EXPECT_EQ(Tracked::live, 0);
+}
+
+TEST(Reclamation, StackStressExternalThreads) {
+    EpochDomain domain;
+    const int kThreads = 8;
+    const int kOps = 20000;
+    std::atomic<int64_t> pushed{0};
+    std::atomic<int64_t> popped{0};
+    {
+        LockFreeStack<Tracked> stack(domain);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < kOps; ++i) {
+                    int value = t * kOps + i;
+                    stack.Push(Tracked(value));
+                    pushed += value;
+                    if (auto top = stack.Pop()) {
+                        popped += top->value;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        RunInThread([&] {
+            while (auto top = stack.Pop()) {
+                popped += top->value;
+            }
+            domain.Collect();
+        });
+    }
+    EXPECT_EQ(pushed, popped);
+    RunInThread([&] { domain.Collect(); });
+    EXPECT_EQ(Tracked::live, 0);
+}
+
+TEST(Reclamation, StackStressWorkers) {
+    const int kTasks = 200;
+    const int kOps = 500;
+    std::atomic<int64_t> pushed{0};
+    std::atomic<int64_t> popped{0};
+    {
+        LockFreeStack<Tracked> stack;
+        {
+            auto pool = MakeThreadPoolExecutor(4);
+            std::vector<std::shared_ptr<Task>> tasks;
+            for (int t = 0; t < kTasks; ++t) {
+                auto task = MakeFunctionTask([&, t] {
+                    for (int i = 0; i < kOps; ++i) {
+                        int value = t * kOps + i;
+                        stack.Push(Tracked(value));
+                        pushed += value;
+                        if (auto top = stack.Pop()) {
+                            popped += top->value;
+                        }
+                    }
+                });
+                pool->Submit(task);
+                tasks.push_back(task);
+            }
+            for (auto& task : tasks) {
+                task->Wait();
+            }
+        }
+        while (auto top = stack.Pop()) {
+            popped += top->value;
+        }
+    }
+    EXPECT_EQ(pushed, popped);
+    EpochDomain::Global().Collect();
+    EXPECT_EQ(Tracked::live, 0);
+}
+
+TEST(Reclamation, StaticExecutorOutlivesGlobalDomainUse) {
+    // Constructed before the global domain is first used, by its own workers, so destroyed after
+    // it: the workers give their records back during static destruction.
+    static Executor pool(2);
+    EXPECT_EQ(pool.Invoke<int>([] { return 1; })->Get(), 1);
+}
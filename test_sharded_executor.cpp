@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <sharded_executor.h>
+#include <spsc_ring.h>
+#include <worker_local.h>
+
+TEST(SpscRing, FifoAndFull) {
+    SpscRing<int, 4> ring;
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(ring.TryPush(int(i)));
+    }
+    EXPECT_FALSE(ring.TryPush(4));
+
+    std::vector<int> popped;
+    EXPECT_EQ(ring.PopBatch(3, [&](int value) { popped.push_back(value); }), 3u);
+    EXPECT_TRUE(ring.TryPush(4));
+    EXPECT_EQ(ring.PopBatch(10, [&](int value) { popped.push_back(value); }), 2u);
+    EXPECT_EQ(popped, (std::vector<int>{0, 1, 2, 3, 4}));
+    EXPECT_TRUE(ring.Empty());
+}
+
+struct ShardedExecutorTest : public ::testing::Test {
+    std::shared_ptr<ShardedExecutor> pool;
+
+    ShardedExecutorTest() {
+        pool = std::make_shared<ShardedExecutor>(3);
+    }
+};
+
+TEST_F(ShardedExecutorTest, RunsOnRequestedShard) {
+    std::vector<FuturePtr<size_t>> shards;
+    for (size_t i = 0; i < 30; ++i) {
+        shards.push_back(pool->InvokeOn<size_t>(i % 3, [] { return CurrentWorkerIndex(); }));
+    }
+    for (size_t i = 0; i < 30; ++i) {
+        EXPECT_EQ(shards[i]->Get(), i % 3);
+    }
+}
+
+TEST_F(ShardedExecutorTest, CrossShardMessagesOverflowRings) {
+    // Far more messages than a ring holds, all sent from one shard to another.
+    const int kMessages = 10 * ShardedExecutor::kRingCapacity;
+    WorkerLocal<int> received(*pool);
+    auto sender = pool->InvokeOn<Unit>(0, [&] {
+        for (int i = 0; i < kMessages; ++i) {
+            pool->SubmitTo(1, MakeFunctionTask([&] { ++received.Local(); }));
+        }
+        return Unit{};
+    });
+    sender->Wait();
+    pool->StartShutdown();
+    pool->WaitShutdown();
+
+    std::vector<int> counts;
+    received.ForEach([&](int count) { counts.push_back(count); });
+    EXPECT_EQ(counts, (std::vector<int>{0, kMessages, 0}));
+}
+
+TEST_F(ShardedExecutorTest, ThenOnRunsOnTargetShard) {
+    auto input = pool->InvokeOn<int>(0, [] { return 20; });
+    auto output = pool->ThenOn<int>(2, input, [&] {
+        EXPECT_EQ(CurrentWorkerIndex(), 2u);
+        return input->Get() + 1;
+    });
+    EXPECT_EQ(output->Get(), 21);
+}
+
+TEST_F(ShardedExecutorTest, ShutdownWaitsForPingPong) {
+    std::atomic<int> bounces = 0;
+    std::function<void(size_t)> bounce = [&](size_t shard) {
+        if (++bounces < 10'000) {
+            pool->SubmitTo((shard + 1) % 3, MakeFunctionTask([&, shard] { bounce(shard + 1); }));
+        }
+    };
+    pool->SubmitTo(0, MakeFunctionTask([&] { bounce(0); }));
+    pool->StartShutdown();
+    pool->WaitShutdown();
+    EXPECT_EQ(bounces.load(), 10'000);
+}
+
+TEST_F(ShardedExecutorTest, RejectsExternalSubmitsAfterShutdown) {
+    pool->StartShutdown();
+    auto task = MakeFunctionTask([] {});
+    EXPECT_FALSE(pool->SubmitTo(1, task));
+    EXPECT_TRUE(task->IsCanceled());
+    pool->WaitShutdown();
+}
+
+TEST_F(ShardedExecutorTest, WaitsForDependencies) {
+    auto first = pool->InvokeOn<int>(1, [] { return 1; });
+    auto second = std::make_shared<Future<int>>([&] { return first->Get() + 1; });
+    second->AddDependency(first);
+    pool->SubmitTo(0, second);
+    EXPECT_EQ(second->Get(), 2);
+}
+
+TEST_F(ShardedExecutorTest, ParkedTaskRunsOnItsShard) {
+    auto input = std::make_shared<Future<int>>();
+    auto output = std::make_shared<Future<int>>([&] {
+        EXPECT_EQ(CurrentWorkerIndex(), 2u);
+        return input->Get() + 1;
+    });
+    output->AddDependency(input);
+    pool->SubmitTo(2, output);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_FALSE(output->IsFinished());
+    input->SetValue(1);
+    EXPECT_EQ(output->Get(), 2);
+}
+
+TEST_F(ShardedExecutorTest, InputFinishingAfterDestruction) {
+    auto input = std::make_shared<Future<int>>();
+    auto parked = std::make_shared<Future<int>>([&] { return input->Get(); });
+    parked->AddDependency(input);
+    pool->SubmitTo(0, parked);
+    auto continuation = pool->ThenOn<int>(1, input, [&] { return input->Get(); });
+
+    // Neither task keeps its shard busy, so the executor is destroyed right away.
+    pool.reset();
+    input->SetValue(1);
+    EXPECT_TRUE(parked->IsCanceled());
+    EXPECT_TRUE(continuation->IsCanceled());
+}
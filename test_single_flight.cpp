@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <single_flight.h>
+
+struct SingleFlightTest : public ::testing::Test {
+    std::shared_ptr<Executor> pool;
+
+    SingleFlightTest() {
+        pool = MakeThreadPoolExecutor(4);
+    }
+};
+
+TEST_F(SingleFlightTest, ConcurrentCallsShareComputation) {
+    SingleFlight<std::string, int> flight(pool);
+    std::atomic<int> computations{0};
+    auto compute = [&] {
+        computations++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return 42;
+    };
+
+    auto first = flight.Do("key", compute);
+    auto second = flight.Do("key", compute);
+    auto other = flight.Do("other", compute);
+
+    EXPECT_EQ(first, second);
+    EXPECT_NE(first, other);
+    EXPECT_EQ(first->Get(), 42);
+    EXPECT_EQ(other->Get(), 42);
+    EXPECT_EQ(computations, 2);
+}
+
+TEST_F(SingleFlightTest, FinishedKeyIsRecomputed) {
+    SingleFlight<int, int> flight(pool);
+    std::atomic<int> computations{0};
+
+    auto first = flight.Do(1, [&] { return ++computations; });
+    EXPECT_EQ(first->Get(), 1);
+    while (flight.InFlight() > 0) {
+        std::this_thread::yield();
+    }
+
+    auto second = flight.Do(1, [&] { return ++computations; });
+    EXPECT_NE(first, second);
+    EXPECT_EQ(second->Get(), 2);
+}
+
+TEST_F(SingleFlightTest, ErrorIsSharedAndReleasesKey) {
+    SingleFlight<int, int> flight(pool);
+    auto gate = std::make_shared<std::atomic<bool>>(false);
+
+    auto first = flight.Do(1, [gate]() -> int {
+        while (!*gate) {
+            std::this_thread::yield();
+        }
+        throw std::logic_error("Test");
+    });
+    auto second = flight.Do(1, [] { return 1; });
+    *gate = true;
+
+    EXPECT_THROW(first->Get(), std::logic_error);
+    EXPECT_THROW(second->Get(), std::logic_error);
+    while (flight.InFlight() > 0) {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(flight.Do(1, [] { return 1; })->Get(), 1);
+}
+
+TEST_F(SingleFlightTest, ManyThreads) {
+    constexpr int kThreads = 8;
+    constexpr int kKeys = 16;
+    constexpr int kRounds = 10;
+    SingleFlight<int, int> flight(pool, 4);
+    std::atomic<int> computations{0};
+
+    for (int round = 0; round < kRounds; round++) {
+        // Every computation stays open until all threads asked for its key, so they must share it.
+        std::vector<std::unique_ptr<std::latch>> arrived;
+        for (int key = 0; key < kKeys; key++) {
+            arrived.push_back(std::make_unique<std::latch>(kThreads));
+        }
+        std::vector<std::thread> clients;
+        for (int t = 0; t < kThreads; t++) {
+            clients.emplace_back([&] {
+                std::vector<FuturePtr<int>> results;
+                for (int key = 0; key < kKeys; key++) {
+                    results.push_back(flight.Do(key, [&, key] {
+                        computations++;
+                        arrived[key]->wait();
+                        return key;
+                    }));
+                    arrived[key]->count_down();
+                }
+                for (int key = 0; key < kKeys; key++) {
+                    EXPECT_EQ(results[key]->Get(), key);
+                }
+            });
+        }
+        for (auto& client : clients) {
+            client.join();
+        }
+        while (flight.InFlight() > 0) {
+            std::this_thread::yield();
+        }
+    }
+    EXPECT_EQ(computations, kKeys * kRounds);
+}
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <static_graph.h>
+
+struct StaticGraphTest : public ::testing::Test {
+    std::shared_ptr<Executor> pool;
+
+    StaticGraphTest() {
+        pool = MakeThreadPoolExecutor(4);
+    }
+};
+
+struct Source {
+    int operator()() const {
+        return 2;
+    }
+};
+
+struct Square {
+    int operator()(int x) const {
+        return x * x;
+    }
+};
+
+struct Negate {
+    int operator()(int x) const {
+        return -x;
+    }
+};
+
+struct Format {
+    std::string operator()(int square, int negated) const {
+        return std::to_string(square) + " " + std::to_string(negated);
+    }
+};
+
+using Diamond = static_graph::Graph<
+    static_graph::Node<Source>, static_graph::Node<Square, static_graph::Deps<Source>>,
+    static_graph::Node<Negate, static_graph::Deps<Source>>,
+    static_graph::Node<Format, static_graph::Deps<Square, Negate>>>;
+
+static_assert(Diamond::kLayer<Source> == 0);
+static_assert(Diamond::kLayer<Negate> == 1);
+static_assert(Diamond::kLayer<Format> == 2);
+static_assert(Diamond::kInDegree<Format> == 2);
+static_assert(std::is_same_v<Diamond::Result<Format>, std::string>);
+
+TEST_F(StaticGraphTest, Diamond) {
+    Diamond graph;
+    graph.Run(*pool);
+
+    EXPECT_EQ(graph.Get<Square>(), 4);
+    EXPECT_EQ(graph.Get<Format>(), "4 -2");
+
+    graph.Run(*pool);
+    EXPECT_EQ(graph.Get<Format>(), "4 -2");
+}
+
+struct Offset {
+    int value;
+
+    int operator()() const {
+        return value;
+    }
+};
+
+TEST_F(StaticGraphTest, FunctionsWithState) {
+    static_graph::Graph<static_graph::Node<Offset>,
+                        static_graph::Node<Square, static_graph::Deps<Offset>>>
+        graph(Offset{5}, Square{});
+    graph.Run(*pool);
+    EXPECT_EQ(graph.Get<Square>(), 25);
+}
+
+struct Sleep {
+    std::atomic<int>* running;
+
+    void operator()() const {
+        ++*running;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+};
+
+struct SleepToo : Sleep {};
+
+struct Join {
+    std::atomic<int>* running;
+
+    int operator()(Unit, Unit) const {
+        return running->load();
+    }
+};
+
+TEST_F(StaticGraphTest, IndependentNodesRunInParallel) {
+    std::atomic<int> running{0};
+    static_graph::Graph<static_graph::Node<Sleep>, static_graph::Node<SleepToo>,
+                        static_graph::Node<Join, static_graph::Deps<Sleep, SleepToo>>>
+        graph(Sleep{&running}, SleepToo{{&running}}, Join{&running});
+
+    auto start = std::chrono::steady_clock::now();
+    graph.Run(*pool);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(graph.Get<Join>(), 2);
+    EXPECT_LT(elapsed, std::chrono::milliseconds(90));
+}
+
+struct Throw {
+    int operator()() const {
+        throw std::logic_error("Failed");
+    }
+};
+
+struct After {
+    bool* called;
+
+    int operator()(int) const {
+        *called = true;
+        return 0;
+    }
+};
+
+TEST_F(StaticGraphTest, ErrorSkipsSuccessors) {
+    bool called = false;
+    static_graph::Graph<static_graph::Node<Throw>,
+                        static_graph::Node<After, static_graph::Deps<Throw>>>
+        graph(Throw{}, After{&called});
+
+    EXPECT_THROW(graph.Run(*pool), std::logic_error);
+    EXPECT_FALSE(called);
+}
+
+TEST_F(StaticGraphTest, DestroyedRightAfterRun) {
+    for (int i = 0; i < 2000; ++i) {
+        auto graph = std::make_unique<Diamond>();
+        graph->Run(*pool);
+        EXPECT_EQ(graph->Get<Format>(), "4 -2");
+    }
+}
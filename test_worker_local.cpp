@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <worker_local.h>
+
+struct WorkerLocalTest : public ::testing::Test {
+    std::shared_ptr<Executor> pool;
+
+    WorkerLocalTest() {
+        pool = MakeThreadPoolExecutor(4);
+    }
+};
+
+TEST_F(WorkerLocalTest, CurrentWorkerIndex) {
+    EXPECT_EQ(CurrentWorkerIndex(), kNoWorker);
+    EXPECT_FALSE(IsWorkerOf(*pool));
+
+    std::vector<FuturePtr<size_t>> indices;
+    for (int i = 0; i < 100; ++i) {
+        indices.push_back(pool->Invoke<size_t>([this] {
+            EXPECT_TRUE(IsWorkerOf(*pool));
+            return CurrentWorkerIndex();
+        }));
+    }
+    for (auto& index : indices) {
+        EXPECT_LT(index->Get(), pool->NumThreads());
+    }
+}
+
+TEST_F(WorkerLocalTest, SumsPerWorker) {
+    WorkerLocal<int64_t> sums(*pool);
+    std::vector<FuturePtr<Unit>> tasks;
+    for (int i = 1; i <= 1000; ++i) {
+        tasks.push_back(pool->Invoke<Unit>([&sums, i] {
+            sums.Local() += i;
+            return Unit{};
+        }));
+    }
+    for (auto& task : tasks) {
+        task->Get();
+    }
+
+    int64_t total = 0;
+    sums.ForEach([&](int64_t sum) { total += sum; });
+    EXPECT_EQ(total, 500500);
+}
+
+TEST_F(WorkerLocalTest, LocalOutsideOfWorkers) {
+    WorkerLocal<int> local(*pool);
+    EXPECT_THROW(local.Local(), std::logic_error);
+    EXPECT_EQ(local.TryLocal(), nullptr);
+
+    auto other = MakeThreadPoolExecutor(1);
+    auto future = other->Invoke<bool>([&] { return local.TryLocal() == nullptr; });
+    EXPECT_TRUE(future->Get());
+}
+
+TEST_F(WorkerLocalTest, ObjectPoolReusesObjects) {
+    auto single = MakeThreadPoolExecutor(1);
+    ObjectPool<std::vector<char>> objects(*single);
+
+    std::set<std::vector<char>*> seen;
+    for (int i = 0; i < 10; ++i) {
+        auto future = single->Invoke<std::vector<char>*>([&objects] {
+            auto buffer = objects.Acquire();
+            buffer->resize(1024);
+            return buffer.get();
+        });
+        seen.insert(future->Get());
+    }
+    EXPECT_EQ(seen.size(), 1u);
+
+    auto outside = objects.Acquire();
+    EXPECT_EQ(seen.count(outside.get()), 0u);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Runs callbacks at given points in time on a thread of its own, earliest first. Callbacks run one
+// after another and should be short, such as submitting a task. The ones still pending when the
+// timer is destroyed run right away, so nothing scheduled is silently dropped.
+class Timer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Timer() {
+        thread_ = std::jthread([this] { Run(); });
+    }
+
+    ~Timer() {
+        {
+            std::lock_guard guard(mutex_);
+            stopped_ = true;
+        }
+        wakeup_.notify_one();
+        thread_.join();
+        while (!events_.empty()) {
+            std::pop_heap(events_.begin(), events_.end(), std::greater<>{});
+            auto callback = std::move(events_.back().callback);
+            events_.pop_back();
+            callback();
+        }
+    }
+
+    Timer(const Timer&) = delete;
+    Timer(Timer&&) = delete;
+
+    Timer& operator=(const Timer&) = delete;
+    Timer& operator=(Timer&&) = delete;
+
+    void At(Clock::time_point when, std::function<void()> callback) {
+        {
+            std::lock_guard guard(mutex_);
+            events_.push_back({when, next_id_++, std::move(callback)});
+            std::push_heap(events_.begin(), events_.end(), std::greater<>{});
+        }
+        wakeup_.notify_one();
+    }
+
+private:
+    struct Event {
+        Clock::time_point when;
+        uint64_t id;
+        std::function<void()> callback;
+
+        // Events due at the same time run in the order they were scheduled.
+        bool operator>(const Event& other) const {
+            return std::tie(when, id) > std::tie(other.when, other.id);
+        }
+    };
+
+    void Run() {
+        std::unique_lock lock(mutex_);
+        while (!stopped_) {
+            if (events_.empty()) {
+                wakeup_.wait(lock);
+                continue;
+            }
+            if (Clock::now() < events_.front().when) {
+                wakeup_.wait_until(lock, events_.front().when);
+                continue;
+            }
+            std::pop_heap(events_.begin(), events_.end(), std::greater<>{});
+            auto callback = std::move(events_.back().callback);
+            events_.pop_back();
+            lock.unlock();
+            callback();
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::vector<Event> events_;
+    uint64_t next_id_ = 0;
+    bool stopped_ = false;
+    std::jthread thread_;
+};
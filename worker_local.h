@@ -0,0 +1,94 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <cache_line.h>
+#include <executors.h>
+
+// One T per worker of an executor, each on its own cache line. A worker only ever touches its own
+// slot through Local(), so no synchronization is needed; reading all slots with ForEach is only
+// safe while no task uses them, e.g. after the tasks were waited for.
+template <class T>
+class WorkerLocal {
+public:
+    template <class E>
+    explicit WorkerLocal(const E& executor)
+        : executor_(&executor), slots_(executor.NumThreads()) {
+    }
+
+    // Slot of the calling worker. Throws if the caller is not a worker of the executor.
+    T& Local() {
+        if (detail::current_worker.executor != executor_) {
+            throw std::logic_error("WorkerLocal: not called from a worker of its executor");
+        }
+        return slots_[detail::current_worker.index].value;
+    }
+
+    // Null if the caller is not a worker of the executor.
+    T* TryLocal() {
+        if (detail::current_worker.executor != executor_) {
+            return nullptr;
+        }
+        return &slots_[detail::current_worker.index].value;
+    }
+
+    template <class F>
+    void ForEach(F fn) {
+        for (auto& slot : slots_) {
+            fn(slot.value);
+        }
+    }
+
+private:
+    const void* executor_;
+    std::vector<CacheLinePadded<T>> slots_;
+};
+
+// Per-worker free lists of T for scratch objects of task bodies. Objects come back to the list of
+// the worker that releases them, up to `max_cached` per worker. Threads that are not workers of the
+// executor always get a fresh object, and the objects they release are destroyed. Objects are
+// reused as they are, so Acquire callers reset whatever state they depend on.
+//
+// Must outlive the objects it handed out.
+template <class T>
+class ObjectPool {
+    struct Releaser {
+        ObjectPool* pool;
+
+        void operator()(T* object) const {
+            pool->Release(object);
+        }
+    };
+
+public:
+    using Handle = std::unique_ptr<T, Releaser>;
+
+    template <class E>
+    explicit ObjectPool(const E& executor, size_t max_cached = 16)
+        : free_(executor), max_cached_(max_cached) {
+    }
+
+    Handle Acquire() {
+        auto* free = free_.TryLocal();
+        if (!free || free->empty()) {
+            return Handle(new T(), Releaser{this});
+        }
+        Handle object(free->back().release(), Releaser{this});
+        free->pop_back();
+        return object;
+    }
+
+private:
+    void Release(T* object) {
+        std::unique_ptr<T> owned(object);
+        auto* free = free_.TryLocal();
+        if (free && free->size() < max_cached_) {
+            free->push_back(std::move(owned));
+        }
+    }
+
+    WorkerLocal<std::vector<std::unique_ptr<T>>> free_;
+    size_t max_cached_;
+};